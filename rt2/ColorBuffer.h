@@ -1,7 +1,9 @@
 #pragma once
 
 #include <string>
+#include <algorithm>
 #include "MathExt.h"
+#include "FrameAllocator.h"
 #include <Windows.h>
 
 #include <codecvt>
@@ -11,6 +13,35 @@ class ColorBuffer
 {
 	std::uint32_t width, height;
 	Vector4* pBuffer = nullptr;
+	// falseȂO(LȂ)̗̈gĂ̂ŉȂ
+	bool ownsBuffer = true;
+
+	std::size_t byteSize() const { return std::size_t(width) * height * sizeof(Vector4); }
+	void releaseBuffer()
+	{
+		if (pBuffer && ownsBuffer) FrameBufferPool::instance().release(pBuffer, byteSize());
+		pBuffer = nullptr;
+	}
+	// v[mۂ(g͕s)
+	void allocate(std::uint32_t w, std::uint32_t h)
+	{
+		if (pBuffer && ownsBuffer && std::size_t(w) * h == std::size_t(width) * height)
+		{
+			width = w;
+			height = h;
+			return;
+		}
+		releaseBuffer();
+		width = w;
+		height = h;
+		pBuffer = static_cast<Vector4*>(FrameBufferPool::instance().acquire(byteSize()));
+		ownsBuffer = true;
+		if (!pBuffer && byteSize() > 0)
+		{
+			std::cout << "error allocating frame buffer(" << w << "x" << h << ")" << std::endl;
+			exit(-5);
+		}
+	}
 public:
 	ColorBuffer()
 	{
@@ -23,13 +54,15 @@ public:
 	}
 	ColorBuffer(const ColorBuffer& cb)
 	{
-		init(cb.width, cb.height);
-		for (std::int32_t y = 0; y < cb.height; y++)
+		allocate(cb.width, cb.height);
+		// clearƓŃRs[
+#pragma omp parallel
+		for (std::int32_t y = 0; y < std::int32_t(height); y++)
 		{
-			auto real_buffer = pBuffer + (y * this->width);
-			auto cb_real_buffer = cb.pBuffer + (y * this->width);
-#pragma omp parallel for
-			for (std::int32_t x = 0; x < cb.width; x++)
+			auto real_buffer = pBuffer + (std::size_t(y) * this->width);
+			auto cb_real_buffer = cb.pBuffer + (std::size_t(y) * this->width);
+#pragma omp for
+			for (std::int32_t x = 0; x < std::int32_t(width); x++)
 			{
 				real_buffer[x] = cb_real_buffer[x];
 			}
@@ -37,28 +70,59 @@ public:
 	}
 	~ColorBuffer()
 	{
-		if (pBuffer) delete[] pBuffer;
+		releaseBuffer();
 	}
 
 	void init(std::uint32_t w, std::uint32_t h)
 	{
-		if (pBuffer) delete[] pBuffer;
+		allocate(w, h);
+		clear();
+	}
+	void attach(Vector4* pExternal, std::uint32_t w, std::uint32_t h)
+	{
+		releaseBuffer();
 		width = w;
 		height = h;
-		pBuffer = new Vector4[width * height];
+		pBuffer = pExternal;
+		ownsBuffer = false;
+	}
+	void clear()
+	{
+		// `惋[vƓ(sƂxeXbhŕS)ŏ
+		// VKɊmۂ̈͂ŏ߂ĐĜŁAy[W͂`悷XbhNUMAm[hɒu
+#pragma omp parallel
+		for (std::int32_t y = 0; y < std::int32_t(height); y++)
+		{
+			auto real_buffer = pBuffer + (std::size_t(y) * this->width);
+#pragma omp for
+			for (std::int32_t x = 0; x < std::int32_t(width); x++) real_buffer[x] = Vector4();
+		}
+	}
+
+	std::uint32_t getWidth() const { return width; }
+	std::uint32_t getHeight() const { return height; }
+	// 1s܂Ƃ߂ēǂނƂp(oȂ)
+	const Vector4* getLine(std::uint32_t y) const { return pBuffer + std::size_t(y) * width; }
+	// src(left, top)玩g̑傫Ԃ؂o
+	void copyRegion(const ColorBuffer& src, std::uint32_t left, std::uint32_t top)
+	{
 #pragma omp parallel for
-		for (std::int32_t i = 0; i < width * height; i++) pBuffer[i] = Vector4();
+		for (std::int32_t y = 0; y < std::int32_t(height); y++)
+		{
+			auto pSrc = src.getLine(top + y) + left;
+			std::copy(pSrc, pSrc + width, pBuffer + std::size_t(y) * width);
+		}
 	}
 
 	void set(const Vector4& pos, const Vector4& col)
 	{
 		if (!pBuffer) return;
-		pBuffer[clamp<std::uint32_t>(pos.x, 0.0, width - 1) + clamp<std::uint32_t>(pos.y, 0.0, height - 1) * width] = col;
+		pBuffer[std::uint32_t(clamp<float>(pos.x, 0.0f, width - 1)) + std::uint32_t(clamp<float>(pos.y, 0.0f, height - 1)) * width] = col;
 	}
 	Vector4 get(const Vector4& pos)
 	{
 		if (!pBuffer) return Vector4();
-		return pBuffer[clamp<std::uint32_t>(pos.x, 0.0, width - 1) + clamp<std::uint32_t>(pos.y, 0.0, height - 1) * width];
+		return pBuffer[std::uint32_t(clamp<float>(pos.x, 0.0f, width - 1)) + std::uint32_t(clamp<float>(pos.y, 0.0f, height - 1)) * width];
 	}
 	Vector4 sample(const Vector4& pos)
 	{
@@ -70,9 +134,9 @@ public:
 
 		auto xd = pos.x - std::uint32_t(pos.x);
 		auto yd = pos.y - std::uint32_t(pos.y);
-		auto t = tl * xd + tr * (1.0 - xd);
-		auto b = bl * xd + br * (1.0 - xd);
-		return t * yd + b * (1.0 - yd);
+		auto t = tl * (1.0 - xd) + tr * xd;
+		auto b = bl * (1.0 - xd) + br * xd;
+		return t * (1.0 - yd) + b * yd;
 	}
 	Vector4 sampleTexCoord(const Vector4& uv)
 	{
@@ -205,6 +269,9 @@ public:
 			return col.dot(Vector4(0.299, 0.587, 0.114, 0.0));
 		};
 
+		// O̓eQƂ(ѕŌʂςȂ悤)
+		ColorBuffer source(*this);
+
 		auto posH = Vector4(0.5 / float(width), 0.5 / float(height));
 		auto posT = Vector4(2.0 / float(width), 2.0 / float(height));
 		for (double y = 0.0; y < height; y++)
@@ -217,11 +284,11 @@ public:
 				auto consolePos = Vector4(TexCoord.x - posH.x, TexCoord.y - posH.y, TexCoord.x + posH.x, TexCoord.y + posH.y);
 
 				// ͂̋Pxf[^
-				auto lumLT = FxaaLuma(sampleTexCoord(consolePos.xy));
-				auto lumLB = FxaaLuma(sampleTexCoord(consolePos.xw));
-				auto lumRT = FxaaLuma(sampleTexCoord(consolePos.zy)) + 0.002604167f;
-				auto lumRB = FxaaLuma(sampleTexCoord(consolePos.zw));
-				auto lumC = FxaaLuma(sampleTexCoord(TexCoord));
+				auto lumLT = FxaaLuma(source.sampleTexCoord(consolePos.xy));
+				auto lumLB = FxaaLuma(source.sampleTexCoord(consolePos.xw));
+				auto lumRT = FxaaLuma(source.sampleTexCoord(consolePos.zy)) + 0.002604167f;
+				auto lumRB = FxaaLuma(source.sampleTexCoord(consolePos.zw));
+				auto lumC = FxaaLuma(source.sampleTexCoord(TexCoord));
 
 				// Px̍ő/ŏ߂
 				auto lumMax = max(max(lumLT, lumLB), max(lumRT, lumRB));
@@ -247,10 +314,10 @@ public:
 
 					// ̂Ƃ߂(d1ƉZȂŋ߂)
 					d1 = d1 * posH;
-					auto cN1 = sampleTexCoord(TexCoord - d1.xy);
-					auto cP1 = sampleTexCoord(TexCoord + d1.xy);
-					auto cN2 = sampleTexCoord(TexCoord - d2.xy);
-					auto cP2 = sampleTexCoord(TexCoord + d2.xy);
+					auto cN1 = source.sampleTexCoord(TexCoord - d1.xy);
+					auto cP1 = source.sampleTexCoord(TexCoord + d1.xy);
+					auto cN2 = source.sampleTexCoord(TexCoord - d2.xy);
+					auto cP2 = source.sampleTexCoord(TexCoord + d2.xy);
 					auto cA = cN1 + cP1;
 					auto cB = (cN2 + cP2 + cA) * 0.25f;
 					auto gray = FxaaLuma(cB);
@@ -270,3 +337,68 @@ public:
 	}
 };
 
+
+// PNGsPʂŏo(摜ŜɎɍς)
+class PortableNetworkGraphStream
+{
+	FILE* fp = nullptr;
+	png_structp pp = nullptr;
+	png_infop ip = nullptr;
+	std::uint32_t width = 0;
+	std::uint8_t* pLineBuffer = nullptr;
+public:
+	PortableNetworkGraphStream(){}
+	PortableNetworkGraphStream(const PortableNetworkGraphStream&) = delete;
+	PortableNetworkGraphStream& operator=(const PortableNetworkGraphStream&) = delete;
+	~PortableNetworkGraphStream()
+	{
+		close();
+	}
+
+	bool open(const std::wstring& fileName, std::uint32_t w, std::uint32_t h)
+	{
+		close();
+		if (_wfopen_s(&fp, fileName.c_str(), L"wb") != 0)
+		{
+			fp = nullptr;
+			return false;
+		}
+		width = w;
+		pLineBuffer = new std::uint8_t[width * 4];
+
+		pp = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+		ip = png_create_info_struct(pp);
+		png_init_io(pp, fp);
+		png_set_IHDR(pp, ip, w, h, 8, PNG_COLOR_TYPE_RGBA,
+			PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+		png_write_info(pp, ip);
+		return true;
+	}
+	void writeRows(ColorBuffer& src, std::uint32_t firstRow, std::uint32_t rowCount)
+	{
+		if (!fp) return;
+		for (std::uint32_t y = firstRow; y < firstRow + rowCount; y++)
+		{
+#pragma omp parallel for
+			for (std::int32_t x = 0; x < this->width; x++)
+			{
+				auto col = src.get(Vector4(x, y));
+				pLineBuffer[x * 4 + 0] = clamp(col.r, 0.0f, 1.0f) * 255;
+				pLineBuffer[x * 4 + 1] = clamp(col.g, 0.0f, 1.0f) * 255;
+				pLineBuffer[x * 4 + 2] = clamp(col.b, 0.0f, 1.0f) * 255;
+				pLineBuffer[x * 4 + 3] = 255; // ignore alpha
+			}
+			png_write_row(pp, pLineBuffer);
+		}
+	}
+	void close()
+	{
+		if (!fp) return;
+		png_write_end(pp, ip);
+		png_destroy_write_struct(&pp, &ip);
+		fclose(fp);
+		fp = nullptr;
+		delete[] pLineBuffer;
+		pLineBuffer = nullptr;
+	}
+};
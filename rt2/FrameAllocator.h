@@ -0,0 +1,115 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <cstdint>
+#include <Windows.h>
+
+// t[obt@(ColorBuffer)p̃v[
+// VirtualAllocŊmۂ̂Ő擪̓y[WE(64oCgE𖞂)Avf̃RXgN^Ȃ
+// ꂽubN̓TCYƂɕێÃt[ōėp(mۂƃy[WtH[g)
+// VKɊmۂubN͌Ăяo`ƓXbhŏ(first-touchNUMAm[hɔzu)
+class FrameBufferPool
+{
+	std::multimap<std::size_t, void*> freeBlocks;
+	std::mutex lock;
+	std::size_t pooledBytes = 0;
+	std::size_t maxPooledBytes = std::size_t(512) << 20;
+	bool largePages = false;
+
+	FrameBufferPool(){}
+
+	// vZX̃g[NSeLockMemoryPrivilegeLɂ(AJEgɂ̌ȂΎs)
+	static bool enableLockMemoryPrivilege()
+	{
+		HANDLE hToken;
+		if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &hToken)) return false;
+		TOKEN_PRIVILEGES tp;
+		tp.PrivilegeCount = 1;
+		tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+		// AdjustTokenPrivileges͌ȂĂԂ̂ŁAGetLastErrorŊm߂
+		bool succeeded = LookupPrivilegeValue(nullptr, SE_LOCK_MEMORY_NAME, &tp.Privileges[0].Luid) &&
+			AdjustTokenPrivileges(hToken, false, &tp, 0, nullptr, nullptr) && GetLastError() != ERROR_NOT_ALL_ASSIGNED;
+		CloseHandle(hToken);
+		return succeeded;
+	}
+
+	// [Wy[Wɂ̂̓[Wy[W1ȏ̑傫̃ubN
+	// (ubN2MBɐ؂グȂAmێɕŒ肳̂first-touch̔zuȂȂ͈͂傫ȃt[Ɍ)
+	bool usesLargePages(std::size_t bytes) const
+	{
+		return largePages && GetLargePageMinimum() > 0 && bytes >= GetLargePageMinimum();
+	}
+	std::size_t roundSize(std::size_t bytes) const
+	{
+		std::size_t unit = usesLargePages(bytes) ? GetLargePageMinimum() : 4096;
+		return (bytes + unit - 1) / unit * unit;
+	}
+public:
+	// IɐÓIColorBufferԋp邱Ƃ̂ŁAjȂ
+	static FrameBufferPool& instance()
+	{
+		static FrameBufferPool* pPool = new FrameBufferPool();
+		return *pPool;
+	}
+
+	// [Wy[WSeLockMemoryPrivilegeKv(mۂłȂΒʏ̃y[Wɂ)
+	// LɂłȂΒʏ̃y[Ŵ܂܂falseԂ
+	bool setLargePages(bool enable)
+	{
+		trim();
+		largePages = enable && enableLockMemoryPrivilege();
+		return largePages == enable;
+	}
+	// ubN̓y[WPʂɐ؂グĕێ̂ŁA悤ɐ؂グ
+	void setMaxPooledBytes(std::size_t bytes)
+	{
+		maxPooledBytes = roundSize(bytes);
+		trim();
+	}
+
+	// mۂłȂnullptrԂ
+	void* acquire(std::size_t bytes)
+	{
+		auto size = roundSize(bytes);
+		{
+			std::lock_guard<std::mutex> lk(lock);
+			auto it = freeBlocks.find(size);
+			if (it != freeBlocks.end())
+			{
+				auto p = it->second;
+				freeBlocks.erase(it);
+				pooledBytes -= size;
+				return p;
+			}
+		}
+
+		void* p = nullptr;
+		if (usesLargePages(bytes)) p = VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES, PAGE_READWRITE);
+		if (!p) p = VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+		return p;
+	}
+	void release(void* p, std::size_t bytes)
+	{
+		if (!p) return;
+		auto size = roundSize(bytes);
+		{
+			std::lock_guard<std::mutex> lk(lock);
+			if (pooledBytes + size <= maxPooledBytes)
+			{
+				freeBlocks.insert(std::make_pair(size, p));
+				pooledBytes += size;
+				return;
+			}
+		}
+		VirtualFree(p, 0, MEM_RELEASE);
+	}
+	// ێĂubNׂĉ
+	void trim()
+	{
+		std::lock_guard<std::mutex> lk(lock);
+		for (auto& e : freeBlocks) VirtualFree(e.second, 0, MEM_RELEASE);
+		freeBlocks.clear();
+		pooledBytes = 0;
+	}
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include "MathExt.h"
+#include "ColorBuffer.h"
+
+// QƉ摜Ƃ̌덷(̔rp)
+// 2̃obt@͓傫ł邱
+namespace ImageMetrics
+{
+	// RGB̕敽ό덷(NvȂ)
+	inline double RootMeanSquareError(const ColorBuffer& a, const ColorBuffer& b)
+	{
+		auto w = a.getWidth(), h = a.getHeight();
+		double sum = 0.0;
+#pragma omp parallel for reduction(+:sum)
+		for (std::int32_t y = 0; y < std::int32_t(h); y++)
+		{
+			auto pa = a.getLine(y), pb = b.getLine(y);
+			for (std::uint32_t x = 0; x < w; x++)
+			{
+				auto d = pa[x] - pb[x];
+				sum += double(d.x) * d.x + double(d.y) * d.y + double(d.z) * d.z;
+			}
+		}
+		return sqrt(sum / (3.0 * w * h));
+	}
+
+	// Px([0, 1]ɃNv)SSIM(11x11, =1.5̃KEXAWang et al. 2004)
+	inline double StructuralSimilarity(const ColorBuffer& a, const ColorBuffer& b)
+	{
+		const std::int32_t radius = 5;
+		const double sigma = 1.5, c1 = 0.01 * 0.01, c2 = 0.03 * 0.03;
+		auto w = std::int32_t(a.getWidth()), h = std::int32_t(a.getHeight());
+		auto size = std::size_t(w) * h;
+
+		double kernel[radius * 2 + 1], kernelSum = 0.0;
+		for (std::int32_t i = -radius; i <= radius; i++) kernelSum += kernel[i + radius] = exp(-(i * i) / (2.0 * sigma * sigma));
+		for (auto& k : kernel) k /= kernelSum;
+
+		// x, y, x^2, y^2, xy5܂Ƃ߂Ăڂ
+		std::vector<double> planes(size * 5), blurred(size * 5), temp(size * 5);
+		auto luminance = [](const Vector4& c) { return clamp(0.299 * c.x + 0.587 * c.y + 0.114 * c.z, 0.0, 1.0); };
+#pragma omp parallel for
+		for (std::int32_t y = 0; y < h; y++)
+		{
+			auto pa = a.getLine(y), pb = b.getLine(y);
+			for (std::int32_t x = 0; x < w; x++)
+			{
+				auto i = std::size_t(y) * w + x;
+				auto la = luminance(pa[x]), lb = luminance(pb[x]);
+				planes[i] = la;
+				planes[size + i] = lb;
+				planes[size * 2 + i] = la * la;
+				planes[size * 3 + i] = lb * lb;
+				planes[size * 4 + i] = la * lb;
+			}
+		}
+		// \Ȃ̂ŉAc̏ɏݍ([̓Nv)
+#pragma omp parallel for
+		for (std::int32_t y = 0; y < h; y++)
+		{
+			for (std::size_t p = 0; p < 5; p++)
+			{
+				for (std::int32_t x = 0; x < w; x++)
+				{
+					double v = 0.0;
+					for (std::int32_t k = -radius; k <= radius; k++) v += kernel[k + radius] * planes[size * p + std::size_t(y) * w + clamp(x + k, 0, w - 1)];
+					temp[size * p + std::size_t(y) * w + x] = v;
+				}
+			}
+		}
+#pragma omp parallel for
+		for (std::int32_t y = 0; y < h; y++)
+		{
+			for (std::size_t p = 0; p < 5; p++)
+			{
+				for (std::int32_t x = 0; x < w; x++)
+				{
+					double v = 0.0;
+					for (std::int32_t k = -radius; k <= radius; k++) v += kernel[k + radius] * temp[size * p + std::size_t(clamp(y + k, 0, h - 1)) * w + x];
+					blurred[size * p + std::size_t(y) * w + x] = v;
+				}
+			}
+		}
+
+		double sum = 0.0;
+#pragma omp parallel for reduction(+:sum)
+		for (std::int32_t i = 0; i < std::int32_t(size); i++)
+		{
+			auto muA = blurred[i], muB = blurred[size + i];
+			auto varA = blurred[size * 2 + i] - muA * muA, varB = blurred[size * 3 + i] - muB * muB;
+			auto covar = blurred[size * 4 + i] - muA * muB;
+			sum += ((2.0 * muA * muB + c1) * (2.0 * covar + c2)) / ((muA * muA + muB * muB + c1) * (varA + varB + c2));
+		}
+		return sum / double(size);
+	}
+}
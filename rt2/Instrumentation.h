@@ -0,0 +1,228 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <codecvt>
+#include <Windows.h>
+#include <intrin.h>
+#include <omp.h>
+#include "MathExt.h"
+#include "ColorBuffer.h"
+
+// vp
+// RT2_INSTRUMENTATION`ƂLɂȂA`Ȃ}N͉Ȃ
+//  - sNZƂ̃C/hitTest/TCN(cost.png, ray_count.pngƂďo)
+//  - XbhƂ̋(Chrome trace event`trace.json)
+// i\(ProgressReporter)͏ɗL
+
+#ifndef RT2_THREAD_LOCAL
+#define RT2_THREAD_LOCAL __declspec(thread)
+#endif
+
+namespace Instrumentation
+{
+#ifdef RT2_INSTRUMENTATION
+	const bool Enabled = true;
+#else
+	const bool Enabled = false;
+#endif
+	const int MaxThreads = 256;
+
+	struct PixelCost
+	{
+		std::uint32_t rays, hitTests;
+		std::uint64_t beginCycles;
+	};
+	struct Span
+	{
+		const char* name;
+		std::int64_t begin, end;
+		std::int32_t arg;
+	};
+
+	static RT2_THREAD_LOCAL PixelCost currentPixel;
+	// XbhԍƂɕĂ̂ŃbN͕sv
+	static std::vector<Span> threadSpans[MaxThreads];
+	static std::int64_t startTicks = 0;
+
+	inline std::int64_t ticks()
+	{
+		LARGE_INTEGER t;
+		QueryPerformanceCounter(&t);
+		return t.QuadPart;
+	}
+	inline void init()
+	{
+		for (auto& v : threadSpans) v.clear();
+		startTicks = ticks();
+	}
+
+	inline void beginPixel()
+	{
+		currentPixel.rays = 0;
+		currentPixel.hitTests = 0;
+		currentPixel.beginCycles = __rdtsc();
+	}
+	inline void endPixel(ColorBuffer* pTarget, const Vector4& pos)
+	{
+		if (!pTarget) return;
+		// x: TCN, y: C, z: hitTest
+		pTarget->set(pos, Vector4(float(__rdtsc() - currentPixel.beginCycles), float(currentPixel.rays), float(currentPixel.hitTests), 1.0f));
+	}
+
+	class ScopedSpan
+	{
+		const char* name;
+		std::int32_t arg;
+		std::int64_t begin;
+	public:
+		ScopedSpan(const char* n, std::int32_t a = -1) : name(n), arg(a), begin(ticks()) {}
+		~ScopedSpan()
+		{
+			auto tid = omp_get_thread_num();
+			if (tid < MaxThreads) threadSpans[tid].push_back(Span{ name, begin, ticks(), arg });
+		}
+	};
+
+	inline void ExportChromeTrace(const std::wstring& fileName)
+	{
+		LARGE_INTEGER freq;
+		QueryPerformanceFrequency(&freq);
+		auto toMicro = [&](std::int64_t t) { return double(t - startTicks) * 1000000.0 / double(freq.QuadPart); };
+
+		FILE* fp = nullptr;
+		if (_wfopen_s(&fp, fileName.c_str(), L"w") != 0) return;
+		fprintf(fp, "{\"traceEvents\":[\n");
+		bool first = true;
+		for (int tid = 0; tid < MaxThreads; tid++)
+		{
+			for (const auto& s : threadSpans[tid])
+			{
+				fprintf(fp, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f", first ? "" : ",\n", s.name, tid, toMicro(s.begin), toMicro(s.end) - toMicro(s.begin));
+				if (s.arg >= 0) fprintf(fp, ",\"args\":{\"index\":%d}", s.arg);
+				fprintf(fp, "}");
+				first = false;
+			}
+		}
+		fprintf(fp, "\n],\"displayTimeUnit\":\"ms\"}\n");
+		fclose(fp);
+	}
+
+	// counters(endPixelŏ)1`l𐳋Kăq[g}bvɂ
+	// TCN̓vGvVȂǂŋɒ[Ȓl̂ŁA99p[Z^Cɂ
+	inline void ExportHeatmap(ColorBuffer& counters, int channel, const std::wstring& fileName)
+	{
+		auto w = counters.getWidth(), h = counters.getHeight();
+		std::vector<float> values(std::size_t(w) * h);
+		for (std::uint32_t y = 0; y < h; y++)
+		{
+			for (std::uint32_t x = 0; x < w; x++)
+			{
+				auto c = counters.get(Vector4(x, y));
+				values[std::size_t(y) * w + x] = (&c.x)[channel];
+			}
+		}
+		if (values.empty()) return;
+		auto pivot = values.begin() + (values.size() - 1) * 99 / 100;
+		std::nth_element(values.begin(), pivot, values.end());
+		auto maxValue = *pivot;
+		std::cout << "heatmap scale(" << std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>>().to_bytes(fileName) << "): " << maxValue << std::endl;
+		if (maxValue <= 0.0f) maxValue = 1.0f;
+
+		ColorBuffer heatmap(w, h);
+#pragma omp parallel for
+		for (std::int32_t y = 0; y < std::int32_t(h); y++)
+		{
+			for (std::uint32_t x = 0; x < w; x++)
+			{
+				auto c = counters.get(Vector4(x, y));
+				auto v = min((&c.x)[channel] / maxValue, 1.0f);
+				// ->->->
+				Vector4 col;
+				if (v < 1.0f / 3.0f) col = Vector4(0.0f, 0.0f, v * 3.0f, 1.0f);
+				else if (v < 2.0f / 3.0f) col = Vector4((v - 1.0f / 3.0f) * 3.0f, 0.0f, 1.0f - (v - 1.0f / 3.0f) * 3.0f, 1.0f);
+				else col = Vector4(1.0f, (v - 2.0f / 3.0f) * 3.0f, 0.0f, 1.0f);
+				heatmap.set(Vector4(x, y), col);
+			}
+		}
+		heatmap.ExportPortableNetworkGraph(fileName);
+	}
+}
+
+#define RT2_CONCAT_IMPL(a, b) a##b
+#define RT2_CONCAT(a, b) RT2_CONCAT_IMPL(a, b)
+#ifdef RT2_INSTRUMENTATION
+#define RT2_COUNT_RAY() (Instrumentation::currentPixel.rays++)
+#define RT2_COUNT_HITTEST() (Instrumentation::currentPixel.hitTests++)
+#define RT2_PIXEL_BEGIN() Instrumentation::beginPixel()
+#define RT2_PIXEL_END(target, pos) Instrumentation::endPixel(target, pos)
+#define RT2_SPAN(...) Instrumentation::ScopedSpan RT2_CONCAT(_rt2Span, __LINE__)(__VA_ARGS__)
+#else
+#define RT2_COUNT_RAY() ((void)0)
+#define RT2_COUNT_HITTEST() ((void)0)
+#define RT2_PIXEL_BEGIN() ((void)0)
+#define RT2_PIXEL_END(target, pos) ((void)0)
+#define RT2_SPAN(...) ((void)0)
+#endif
+
+// `惋[v̓Ag~bNȃJE^i߂邾ɂāA\͕ʃXbhōs
+class ProgressReporter
+{
+	std::atomic<std::uint32_t> done;
+	std::atomic<bool> running;
+	std::uint32_t total = 0;
+	std::string label;
+	std::thread reporter;
+
+	void print(std::uint32_t d)
+	{
+		std::cout << std::setw(2) << std::setfill('0') << int((double(d) / double(total)) * 100.0) << "% " << label << "(" << d << "/" << total << ")" << std::endl;
+	}
+public:
+	ProgressReporter()
+	{
+		done.store(0);
+		running.store(false);
+	}
+	~ProgressReporter()
+	{
+		stop();
+	}
+
+	void start(const std::string& l, std::uint32_t t)
+	{
+		stop();
+		label = l;
+		total = t;
+		done.store(0, std::memory_order_relaxed);
+		running.store(true, std::memory_order_release);
+		reporter = std::thread([this]()
+		{
+			std::uint32_t last = ~0u;
+			while (running.load(std::memory_order_acquire))
+			{
+				auto d = done.load(std::memory_order_relaxed);
+				if (d != last) print(d);
+				last = d;
+				std::this_thread::sleep_for(std::chrono::milliseconds(250));
+			}
+		});
+	}
+	void advance(std::uint32_t n = 1)
+	{
+		done.fetch_add(n, std::memory_order_relaxed);
+	}
+	void stop()
+	{
+		if (!reporter.joinable()) return;
+		running.store(false, std::memory_order_release);
+		reporter.join();
+		print(done.load(std::memory_order_relaxed));
+	}
+};
@@ -0,0 +1,307 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <Windows.h>
+#include "MathExt.h"
+#include "ColorBuffer.h"
+
+// ColorBuffer𖼑Ot̃C[Ƃ1̃t@Cɏo
+// `OpenEXR(VOp[gA^CAONE_LEVEL)Ȃ̂ŃR|Wbgc[ł̂܂ܓǂ߂
+//  - `l"C[."(C[Ȃ琬̂݁ACRGBɎg)
+//  - l̓Nvhalf(16bit_)floatŊi[
+//  - k͂ȂRLE(EXŘ`̂܂: oCg +  + OX)
+
+// lEXRpixelTypeƓ
+enum class LayerPixelType : std::int32_t
+{
+	Half = 1,
+	Float = 2
+};
+// lEXRcompressionƓ
+enum class LayeredImageCompression : std::uint8_t
+{
+	None = 0,
+	RLE = 1
+};
+
+// ŋߐڋۂ(񐳋KAANaN)
+inline std::uint16_t FloatToHalf(float f)
+{
+	std::uint32_t x;
+	std::memcpy(&x, &f, sizeof x);
+	std::uint32_t sign = (x >> 16) & 0x8000;
+	std::uint32_t absx = x & 0x7fffffff;
+
+	// /NaN
+	if (absx >= 0x7f800000) return std::uint16_t(sign | 0x7c00 | (absx > 0x7f800000 ? 0x0200 : 0));
+	// halfŕ\Ȃ傫(65536ȏ)͖
+	if (absx >= 0x47800000) return std::uint16_t(sign | 0x7c00);
+	if (absx < 0x38800000)
+	{
+		// half̔񐳋K(2^-14)
+		if (absx < 0x33000000) return std::uint16_t(sign);
+		auto e = absx >> 23;
+		auto m = (absx & 0x7fffff) | 0x800000;
+		auto shift = 126 - e;
+		auto r = m >> shift;
+		auto rem = m & ((1u << shift) - 1);
+		auto halfway = 1u << (shift - 1);
+		if (rem > halfway || (rem == halfway && (r & 1))) r++;
+		return std::uint16_t(sign | r);
+	}
+	// w̃oCAX12715ɂ(ۂ߂ŌJオ΂̂܂ܖɂȂ)
+	auto r = (absx - 0x38000000) >> 13;
+	auto rem = absx & 0x1fff;
+	if (rem > 0x1000 || (rem == 0x1000 && (r & 1))) r++;
+	return std::uint16_t(sign | r);
+}
+
+class LayeredImageWriter
+{
+	struct Channel
+	{
+		std::string name;
+		ColorBuffer* pSource;
+		int component;
+		LayerPixelType type;
+	};
+	std::vector<Channel> channels;
+	std::uint32_t width, height;
+	std::uint32_t tileSize;
+
+	template<typename T> static void put(std::vector<std::uint8_t>& out, const T& v)
+	{
+		auto p = reinterpret_cast<const std::uint8_t*>(&v);
+		out.insert(out.end(), p, p + sizeof(T));
+	}
+	static void putString(std::vector<std::uint8_t>& out, const std::string& s)
+	{
+		out.insert(out.end(), s.begin(), s.end());
+		out.push_back(0);
+	}
+	static void putAttribute(std::vector<std::uint8_t>& out, const std::string& name, const std::string& type, const std::vector<std::uint8_t>& value)
+	{
+		putString(out, name);
+		putString(out, type);
+		put(out, std::int32_t(value.size()));
+		out.insert(out.end(), value.begin(), value.end());
+	}
+	std::vector<std::uint8_t> makeHeader(LayeredImageCompression compression) const
+	{
+		std::vector<std::uint8_t> header, value;
+		// magic, version 2 + ^C`tO
+		put(header, std::int32_t(20000630));
+		put(header, std::int32_t(2 | 0x200));
+
+		for (const auto& ch : channels)
+		{
+			putString(value, ch.name);
+			put(value, std::int32_t(ch.type));
+			// pLinear + reserved
+			put(value, std::int32_t(0));
+			// xSampling, ySampling
+			put(value, std::int32_t(1));
+			put(value, std::int32_t(1));
+		}
+		value.push_back(0);
+		putAttribute(header, "channels", "chlist", value);
+
+		value.assign(1, std::uint8_t(compression));
+		putAttribute(header, "compression", "compression", value);
+
+		value.clear();
+		put(value, std::int32_t(0));
+		put(value, std::int32_t(0));
+		put(value, std::int32_t(width - 1));
+		put(value, std::int32_t(height - 1));
+		putAttribute(header, "dataWindow", "box2i", value);
+		putAttribute(header, "displayWindow", "box2i", value);
+
+		// INCREASING_Y
+		value.assign(1, 0);
+		putAttribute(header, "lineOrder", "lineOrder", value);
+
+		value.clear();
+		put(value, 1.0f);
+		putAttribute(header, "pixelAspectRatio", "float", value);
+
+		value.clear();
+		put(value, 0.0f);
+		put(value, 0.0f);
+		putAttribute(header, "screenWindowCenter", "v2f", value);
+
+		value.clear();
+		put(value, 1.0f);
+		putAttribute(header, "screenWindowWidth", "float", value);
+
+		// ONE_LEVEL, ROUND_DOWN
+		value.clear();
+		put(value, tileSize);
+		put(value, tileSize);
+		value.push_back(0);
+		putAttribute(header, "tiles", "tiledesc", value);
+
+		header.push_back(0);
+		return header;
+	}
+
+	// ^C̍sƂɁA`l1sׂ
+	void packTile(std::uint32_t left, std::uint32_t top, std::uint32_t w, std::uint32_t h, std::vector<std::uint8_t>& out)
+	{
+		std::size_t rowBytes = 0;
+		for (const auto& ch : channels) rowBytes += w * (ch.type == LayerPixelType::Half ? sizeof(std::uint16_t) : sizeof(float));
+		out.resize(rowBytes * h);
+		auto pOut = out.data();
+		for (auto y = top; y < top + h; y++)
+		{
+			for (const auto& ch : channels)
+			{
+				auto pLine = ch.pSource->getLine(y) + left;
+				if (ch.type == LayerPixelType::Half)
+				{
+					for (std::uint32_t x = 0; x < w; x++)
+					{
+						auto hv = FloatToHalf((&pLine[x].x)[ch.component]);
+						std::memcpy(pOut, &hv, sizeof hv);
+						pOut += sizeof hv;
+					}
+				}
+				else
+				{
+					for (std::uint32_t x = 0; x < w; x++)
+					{
+						std::memcpy(pOut, &(&pLine[x].x)[ch.component], sizeof(float));
+						pOut += sizeof(float);
+					}
+				}
+			}
+		}
+	}
+	// kČ菬ȂȂΌ̃f[^Ԃ(ǂݍݑ̓TCYŔʂ)
+	static void compressRLE(const std::vector<std::uint8_t>& raw, std::vector<std::uint8_t>& out)
+	{
+		// ԖڂƊԖڂ̃oCg𕪂AׂƂ̍ɂ
+		std::vector<std::uint8_t> tmp(raw.size());
+		auto half = (raw.size() + 1) / 2;
+		for (std::size_t i = 0; i < raw.size() / 2; i++)
+		{
+			tmp[i] = raw[i * 2];
+			tmp[half + i] = raw[i * 2 + 1];
+		}
+		if (raw.size() & 1) tmp[half - 1] = raw.back();
+		for (std::size_t i = tmp.size() - 1; i > 0; i--) tmp[i] = std::uint8_t(int(tmp[i]) - int(tmp[i - 1]) + 128);
+
+		// 3oCgȏ̘A( - 1, l)AȊO(-, l...)
+		const std::ptrdiff_t minRun = 3, maxRun = 127;
+		out.resize(raw.size() + raw.size() / 2 + 1);
+		auto pOut = out.data();
+		auto inEnd = tmp.data() + tmp.size();
+		auto runStart = tmp.data();
+		auto runEnd = runStart + 1;
+		while (runStart < inEnd)
+		{
+			while (runEnd < inEnd && *runStart == *runEnd && runEnd - runStart - 1 < maxRun) runEnd++;
+			if (runEnd - runStart >= minRun)
+			{
+				*pOut++ = std::uint8_t(runEnd - runStart - 1);
+				*pOut++ = *runStart;
+				runStart = runEnd;
+			}
+			else
+			{
+				while (runEnd < inEnd &&
+					((runEnd + 1 >= inEnd || *runEnd != *(runEnd + 1)) || (runEnd + 2 >= inEnd || *(runEnd + 1) != *(runEnd + 2))) &&
+					runEnd - runStart < maxRun) runEnd++;
+				*pOut++ = std::uint8_t(runStart - runEnd);
+				while (runStart < runEnd) *pOut++ = *runStart++;
+			}
+			runEnd++;
+		}
+		out.resize(pOut - out.data());
+		if (out.size() >= raw.size()) out = raw;
+	}
+public:
+	LayeredImageWriter(std::uint32_t w, std::uint32_t h, std::uint32_t tile = 64) : width(w), height(h), tileSize(tile) {}
+
+	// componentNames̏sourcex, y, z, w蓖Ă
+	void addLayer(const std::string& layerName, ColorBuffer& source, const std::vector<std::string>& componentNames, LayerPixelType type)
+	{
+		for (std::size_t i = 0; i < componentNames.size() && i < 4; i++)
+		{
+			Channel ch;
+			ch.name = layerName.empty() ? componentNames[i] : layerName + "." + componentNames[i];
+			ch.pSource = &source;
+			ch.component = int(i);
+			ch.type = type;
+			channels.push_back(ch);
+		}
+	}
+
+	bool write(const std::wstring& fileName, LayeredImageCompression compression = LayeredImageCompression::RLE)
+	{
+		// `l͖Oɕׂ錈܂
+		std::sort(channels.begin(), channels.end(), [](const Channel& a, const Channel& b) { return a.name < b.name; });
+
+		auto tilesX = (width + tileSize - 1) / tileSize;
+		auto tilesY = (height + tileSize - 1) / tileSize;
+		std::vector<std::vector<std::uint8_t>> chunks(tilesX * tilesY);
+#pragma omp parallel
+		{
+			std::vector<std::uint8_t> raw;
+#pragma omp for schedule(dynamic)
+			for (std::int32_t i = 0; i < std::int32_t(chunks.size()); i++)
+			{
+				auto tx = std::uint32_t(i) % tilesX, ty = std::uint32_t(i) / tilesX;
+				auto left = tx * tileSize, top = ty * tileSize;
+				auto w = min(tileSize, width - left), h = min(tileSize, height - top);
+				packTile(left, top, w, h, raw);
+
+				auto& chunk = chunks[i];
+				// tileX, tileY, levelX, levelY, dataSize, data
+				put(chunk, std::int32_t(tx));
+				put(chunk, std::int32_t(ty));
+				put(chunk, std::int32_t(0));
+				put(chunk, std::int32_t(0));
+				if (compression == LayeredImageCompression::RLE)
+				{
+					std::vector<std::uint8_t> packed;
+					compressRLE(raw, packed);
+					put(chunk, std::int32_t(packed.size()));
+					chunk.insert(chunk.end(), packed.begin(), packed.end());
+				}
+				else
+				{
+					put(chunk, std::int32_t(raw.size()));
+					chunk.insert(chunk.end(), raw.begin(), raw.end());
+				}
+			}
+		}
+
+		auto header = makeHeader(compression);
+		// ^C̃ItZbg\(t@C擪̈ʒu)
+		std::vector<std::uint8_t> offsets;
+		auto pos = std::uint64_t(header.size() + chunks.size() * sizeof(std::uint64_t));
+		for (const auto& c : chunks)
+		{
+			put(offsets, pos);
+			pos += c.size();
+		}
+
+		auto hFile = CreateFile(fileName.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (hFile == INVALID_HANDLE_VALUE) return false;
+		DWORD dwWrittenSize;
+		bool succeeded = WriteFile(hFile, header.data(), DWORD(header.size()), &dwWrittenSize, nullptr) &&
+			WriteFile(hFile, offsets.data(), DWORD(offsets.size()), &dwWrittenSize, nullptr);
+		for (const auto& c : chunks)
+		{
+			if (!succeeded) break;
+			succeeded = WriteFile(hFile, c.data(), DWORD(c.size()), &dwWrittenSize, nullptr) != 0;
+		}
+		CloseHandle(hFile);
+		return succeeded;
+	}
+};
@@ -2,6 +2,7 @@
 
 #include <cstdint>
 #include <iostream>
+#include <array>
 #include <emmintrin.h>
 #define _USE_MATH_DEFINES
 #include <math.h>
@@ -149,6 +150,93 @@ public:
 	}
 };
 
+class Matrix4
+{
+public:
+	// sxNg4{ŕ\(v' = M * v)
+	Vector4 rows[4];
+
+	Matrix4()
+	{
+		rows[0] = Vector4(1.0f, 0.0f, 0.0f, 0.0f);
+		rows[1] = Vector4(0.0f, 1.0f, 0.0f, 0.0f);
+		rows[2] = Vector4(0.0f, 0.0f, 1.0f, 0.0f);
+		rows[3] = Vector4(0.0f, 0.0f, 0.0f, 1.0f);
+	}
+	Matrix4(const Vector4& r0, const Vector4& r1, const Vector4& r2, const Vector4& r3)
+	{
+		rows[0] = r0; rows[1] = r1; rows[2] = r2; rows[3] = r3;
+	}
+
+	static Matrix4 translate(const Vector4& t)
+	{
+		return Matrix4(Vector4(1.0f, 0.0f, 0.0f, t.x), Vector4(0.0f, 1.0f, 0.0f, t.y), Vector4(0.0f, 0.0f, 1.0f, t.z), Vector4(0.0f, 0.0f, 0.0f, 1.0f));
+	}
+	static Matrix4 scale(const Vector4& s)
+	{
+		return Matrix4(Vector4(s.x, 0.0f, 0.0f, 0.0f), Vector4(0.0f, s.y, 0.0f, 0.0f), Vector4(0.0f, 0.0f, s.z, 0.0f), Vector4(0.0f, 0.0f, 0.0f, 1.0f));
+	}
+	// Vector4::rotX/rotY/rotZƓ
+	static Matrix4 rotX(float deg)
+	{
+		auto rad = deg * (M_PI / 180.0);
+		return Matrix4(Vector4(1.0f, 0.0f, 0.0f, 0.0f), Vector4(0.0f, cos(rad), -sin(rad), 0.0f), Vector4(0.0f, sin(rad), cos(rad), 0.0f), Vector4(0.0f, 0.0f, 0.0f, 1.0f));
+	}
+	static Matrix4 rotY(float deg)
+	{
+		auto rad = deg * (M_PI / 180.0);
+		return Matrix4(Vector4(cos(rad), 0.0f, sin(rad), 0.0f), Vector4(0.0f, 1.0f, 0.0f, 0.0f), Vector4(-sin(rad), 0.0f, cos(rad), 0.0f), Vector4(0.0f, 0.0f, 0.0f, 1.0f));
+	}
+	static Matrix4 rotZ(float deg)
+	{
+		auto rad = deg * (M_PI / 180.0);
+		return Matrix4(Vector4(cos(rad), -sin(rad), 0.0f, 0.0f), Vector4(sin(rad), cos(rad), 0.0f, 0.0f), Vector4(0.0f, 0.0f, 1.0f, 0.0f), Vector4(0.0f, 0.0f, 0.0f, 1.0f));
+	}
+
+	Vector4 column(int i) const
+	{
+		const float* r0 = &rows[0].x;
+		const float* r1 = &rows[1].x;
+		const float* r2 = &rows[2].x;
+		const float* r3 = &rows[3].x;
+		return Vector4(r0[i], r1[i], r2[i], r3[i]);
+	}
+	Vector4 transform(const Vector4& v) const
+	{
+		return Vector4(rows[0].dot(v), rows[1].dot(v), rows[2].dot(v), rows[3].dot(v));
+	}
+	Matrix4 operator*(const Matrix4& m) const
+	{
+		std::array<Vector4, 4> cols = { m.column(0), m.column(1), m.column(2), m.column(3) };
+		Matrix4 res;
+		for (int i = 0; i < 4; i++)
+		{
+			res.rows[i] = Vector4(rows[i].dot(cols[0]), rows[i].dot(cols[1]), rows[i].dot(cols[2]), rows[i].dot(cols[3]));
+		}
+		return res;
+	}
+	Matrix4 transpose() const
+	{
+		return Matrix4(column(0), column(1), column(2), column(3));
+	}
+	Matrix4 inverseAffine() const
+	{
+		// 3x3]qŋtsɂAsړ -R^-1 * t
+		auto c0 = column(0), c1 = column(1), c2 = column(2);
+		auto x0 = c1.cross3(c2), x1 = c2.cross3(c0), x2 = c0.cross3(c1);
+		x0.w = x1.w = x2.w = 0.0f;
+		auto det = c0.x * x0.x + c0.y * x0.y + c0.z * x0.z;
+		if (det == 0) return Matrix4();
+		x0 = x0 / det; x1 = x1 / det; x2 = x2 / det;
+		auto t = Vector4(rows[0].w, rows[1].w, rows[2].w, 0.0f);
+		return Matrix4(
+			Vector4(x0.x, x0.y, x0.z, -x0.dot(t)),
+			Vector4(x1.x, x1.y, x1.z, -x1.dot(t)),
+			Vector4(x2.x, x2.y, x2.z, -x2.dot(t)),
+			Vector4(0.0f, 0.0f, 0.0f, 1.0f));
+	}
+};
+
 class Ray
 {
 	Vector4 startPos;
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <vector>
+#include <limits>
 #include "MathExt.h"
+#include "Texture.h"
 
 struct hitTestResult
 {
@@ -12,16 +15,64 @@ struct hitTestResult
 class IObjectBase
 {
 	Vector4 Pos, surfaceColor;
+	ITexture* pTexture = nullptr;
 public:
 	IObjectBase(const Vector4& p, const Vector4& c) : Pos(p), surfaceColor(c) {}
 	virtual ~IObjectBase(){}
 
 	auto getPos() -> decltype(Pos) const { return Pos; }
 	auto getColor() -> decltype(surfaceColor) const { return surfaceColor; }
+	auto getTexture() -> decltype(pTexture) const { return pTexture; }
+	void setTexture(ITexture* t) { pTexture = t; }
+
+	// \ʏ̓_p̃eNX`WƁAUV 1̃[hԂł̒
+	virtual Vector4 getTexCoord(const Vector4& p) { return Vector4(); }
+	virtual double getTexCoordScale() { return 1.0; }
+	// footprint: _pł1sNZ̃[hԂł̕
+	virtual Vector4 getSurfaceColor(const Vector4& p, double footprint)
+	{
+		if (!pTexture) return surfaceColor;
+		return surfaceColor * pTexture->sample(getTexCoord(p), float(footprint / getTexCoordScale()));
+	}
 
 	virtual hitTestResult hitTest(const Ray& r) = 0;
+	// ̑Ŝދ(E)Bʂ̂悤ɖɍL镨̂falseԂ
+	virtual bool getBoundingSphere(Vector4& center, double& radius) { return false; }
+	// (AO̍ċȀI[Ŏg̐FԂ)
+	virtual bool isEmissive() { return false; }
+	// InstanceQƂꂽƂɌĂ΂(E荞܂̂ŁAȍ~͌`ςĂ͂Ȃ)
+	virtual void freeze() {}
 };
 
+// C(͐Kς)EɓȂtrue(n_̒ɂΓƂ݂Ȃ)
+inline bool missesBoundingSphere(const Ray& r, const Vector4& center, double radius)
+{
+	auto oc = center - r.getStartPos();
+	oc.w = 0;
+	auto dist2 = double(oc.length2()), r2 = radius * radius;
+	if (dist2 <= r2) return false;
+	auto tca = double(oc.dot(r.getDirection()));
+	if (tca < 0) return true;
+	return dist2 - tca * tca > r2;
+}
+// 2̋E܂Ƃ߂ĕދ
+inline void mergeBoundingSphere(Vector4& center, double& radius, const Vector4& otherCenter, double otherRadius)
+{
+	auto d = otherCenter - center;
+	d.w = 0;
+	double dist = d.length();
+	if (dist + otherRadius <= radius) return;
+	if (dist + radius <= otherRadius)
+	{
+		center = otherCenter;
+		radius = otherRadius;
+		return;
+	}
+	auto newRadius = (dist + radius + otherRadius) * 0.5;
+	center = center + d * float((newRadius - radius) / dist);
+	radius = newRadius;
+}
+
 class Sphere : public IObjectBase
 {
 	double radius;
@@ -30,6 +81,12 @@ public:
 	virtual ~Sphere(){}
 
 	auto getRadius() -> decltype(radius) const { return radius; }
+	virtual bool getBoundingSphere(Vector4& center, double& r)
+	{
+		center = getPos();
+		r = radius;
+		return true;
+	}
 	virtual hitTestResult hitTest(const Ray& r)
 	{
 		// ̕\ʂ̔Cӂ̓_P(||P-C|| = r)R(R(t) = S + Vt)̏ɂ邩ǂT
@@ -64,6 +121,39 @@ public:
 		}
 		return hitTestResult{ false, 0.0, Vector4() };
 	}
+	virtual Vector4 getTexCoord(const Vector4& p)
+	{
+		// oxܓxŃ}bsO(v͏(-y)0)
+		auto d = p - this->getPos();
+		d.w = 0;
+		d = d.normalize();
+		auto u = 0.5 + atan2(d.z, d.x) / (2.0 * M_PI);
+		auto v = acos(clamp(-d.y, -1.0f, 1.0f)) / M_PI;
+		return Vector4(u, v);
+	}
+	virtual double getTexCoordScale() { return 2.0 * M_PI * radius; }
+	double occlusion(const Vector4& p, const Vector4& n)
+	{
+		// _P猩̗̊p(]dݕt)͓Iɋ߂
+		// L̒Sւ̕Al = ||C - P||Ah = l / rƂ
+		// n芮Sɏɂ occ = dot(N, L) / h^2
+		// nŐ؂ꍇ͋̐ϕŕ␳
+		auto di = this->getPos() - p;
+		di.w = 0;
+		auto l = di.length();
+		if (l <= radius) return 1.0;
+		auto nl = n.dot(di / l);
+		auto h2 = pow(l / radius, 2.0);
+		auto k2 = 1.0 - h2 * nl * nl;
+		auto res = max(0.0, double(nl)) / h2;
+		if (k2 > 0.001)
+		{
+			res = nl * acos(clamp(-nl * sqrt((h2 - 1.0) / (1.0 - nl * nl)), -1.0, 1.0)) - sqrt(k2 * (h2 - 1.0));
+			res = res / h2 + atan(sqrt(k2 / (h2 - 1.0)));
+			res /= M_PI;
+		}
+		return clamp(res, 0.0, 1.0);
+	}
 };
 
 class Plane : public IObjectBase
@@ -74,6 +164,8 @@ public:
 	virtual ~Plane(){}
 
 	auto getNormal() -> decltype(Normal) const { return Normal; }
+	// ʂ͔
+	virtual bool isEmissive() { return true; }
 	virtual hitTestResult hitTest(const Ray& r)
 	{
 		// ʏ̔Cӂ̓_P(dot(P - C, N) = 0)C(P(t) = S + Vt)Ɋ܂܂邩ǂ
@@ -132,4 +224,163 @@ public:
 		if (binDist > binLength * binLength) return hitTestResult{ false, t, Vector4() };
 		return hitTestResult{ true, t, getNormal() };
 	}
+	virtual Vector4 getTexCoord(const Vector4& p)
+	{
+		// Tangent/Binormal[-len, len][0, 1]Ɋ蓖Ă
+		auto crossPos = p - this->getPos();
+		crossPos.w = 0;
+		auto tan = Tangent.normalize();
+		auto bin = tan.cross3(Normal).normalize();
+		return Vector4((crossPos.dot(tan) / tanLength + 1.0f) * 0.5f, (crossPos.dot(bin) / binLength + 1.0f) * 0.5f);
+	}
+	virtual double getTexCoordScale() { return 2.0 * max(tanLength, binLength); }
+	virtual bool getBoundingSphere(Vector4& center, double& radius)
+	{
+		center = getPos();
+		radius = sqrt(double(tanLength) * tanLength + double(binLength) * binLength);
+		return true;
+	}
+};
+
+class ObjectGroup : public IObjectBase
+{
+	std::vector<IObjectBase*> Children;
+	// qIuWFNgׂĂ̋E(ÊȂqbounded = false)
+	// Instance͐ɂ荞ނ̂ŁAInstance(frozen)ɎqǉƃG[ɂ
+	bool bounded = true;
+	bool frozen = false;
+	Vector4 boundCenter;
+	double boundRadius = -1.0;
+public:
+	ObjectGroup(const Vector4& p, const Vector4& c) : IObjectBase(p, c) {}
+	virtual ~ObjectGroup(){}
+
+	virtual void freeze() { frozen = true; }
+	void add(IObjectBase* o)
+	{
+		if (frozen)
+		{
+			std::cout << "ObjectGroup: cannot add children after the group is instanced" << std::endl;
+			exit(-6);
+		}
+		Children.push_back(o);
+		Vector4 center;
+		double radius;
+		if (!o->getBoundingSphere(center, radius)) bounded = false;
+		else if (boundRadius < 0)
+		{
+			boundCenter = center;
+			boundRadius = radius;
+		}
+		else mergeBoundingSphere(boundCenter, boundRadius, center, radius);
+	}
+	auto getChildren() -> decltype(Children)& { return Children; }
+	virtual bool getBoundingSphere(Vector4& center, double& radius)
+	{
+		if (!bounded) return false;
+		center = boundCenter;
+		radius = max(boundRadius, 0.0);
+		return true;
+	}
+	virtual hitTestResult hitTest(const Ray& r)
+	{
+		// qIuWFNg̒ňԋ߂_Ԃ
+		hitTestResult nearest = { false, std::numeric_limits<double>::max(), Vector4() };
+		if (bounded && (boundRadius < 0 || missesBoundingSphere(r, boundCenter, boundRadius))) return nearest;
+		for (const auto& e : Children)
+		{
+			auto hitInfo = e->hitTest(r);
+			if (hitInfo.hit && hitInfo.hitRayPosition < nearest.hitRayPosition) nearest = hitInfo;
+		}
+		return nearest;
+	}
+};
+
+class Instance : public IObjectBase
+{
+	// LꂽWIg(ObjectGroupȂ)AtBϊĔzu
+	// ێ̂̓[h->IuWFNgԂ̋tsƁA[hԂ̋E
+	// EɓȂC͕ϊɊp
+	IObjectBase* pGeometry;
+	Matrix4 worldToObject;
+	bool bounded;
+	Vector4 boundCenter;
+	double boundRadius;
+	// eNX`W̃XP[p̕ς̊g嗦(`̍s񎮂3捪)
+	double uniformScale;
+public:
+	Instance(IObjectBase* g, const Matrix4& objectToWorld, const Vector4& c)
+		: IObjectBase(Vector4(objectToWorld.rows[0].w, objectToWorld.rows[1].w, objectToWorld.rows[2].w, 1.0), c), pGeometry(g), worldToObject(objectToWorld.inverseAffine())
+	{
+		g->freeze();
+		const auto& r0 = objectToWorld.rows[0];
+		const auto& r1 = objectToWorld.rows[1];
+		const auto& r2 = objectToWorld.rows[2];
+		auto det = double(r0.x) * (double(r1.y) * r2.z - double(r1.z) * r2.y) - double(r0.y) * (double(r1.x) * r2.z - double(r1.z) * r2.x) + double(r0.z) * (double(r1.x) * r2.y - double(r1.y) * r2.x);
+		uniformScale = pow(fabs(det), 1.0 / 3.0);
+
+		double radius;
+		bounded = g->getBoundingSphere(boundCenter, radius);
+		if (!bounded) return;
+		boundCenter.w = 1.0;
+		boundCenter = objectToWorld.transform(boundCenter);
+		// a͐`A̍őْl{(A^T ǍŗLlGershgorin̒藝ŏォ}A]Ɠ{gȂ猵)
+		double ata[3][3], maxRowSum = 0.0;
+		for (int i = 0; i < 3; i++)
+		{
+			for (int j = 0; j < 3; j++)
+			{
+				ata[i][j] = 0.0;
+				for (int k = 0; k < 3; k++) ata[i][j] += double((&objectToWorld.rows[k].x)[i]) * (&objectToWorld.rows[k].x)[j];
+			}
+		}
+		for (int i = 0; i < 3; i++) maxRowSum = max(maxRowSum, fabs(ata[i][0]) + fabs(ata[i][1]) + fabs(ata[i][2]));
+		boundRadius = radius * sqrt(maxRowSum);
+	}
+	virtual ~Instance(){}
+
+	auto getGeometry() -> decltype(pGeometry) const { return pGeometry; }
+	virtual bool isEmissive() { return pGeometry->isEmissive(); }
+	// eNX`W̓IuWFNgԂɖ߂ăWIgɋ߂
+	virtual Vector4 getTexCoord(const Vector4& p)
+	{
+		auto local = p;
+		local.w = 1.0;
+		return pGeometry->getTexCoord(worldToObject.transform(local));
+	}
+	virtual double getTexCoordScale() { return pGeometry->getTexCoordScale() * uniformScale; }
+	// CX^XgɃeNX`Ȃ΃WIg̃eNX`g(F̓CX^X̐F)
+	// ObjectGroup̎q̃eNX`́Aǂ̎qɓȂ̂ŎgȂ
+	virtual Vector4 getSurfaceColor(const Vector4& p, double footprint)
+	{
+		auto pTex = getTexture() ? getTexture() : pGeometry->getTexture();
+		if (!pTex) return getColor();
+		return getColor() * pTex->sample(getTexCoord(p), float(footprint / getTexCoordScale()));
+	}
+	virtual bool getBoundingSphere(Vector4& center, double& radius)
+	{
+		if (!bounded) return false;
+		center = boundCenter;
+		radius = boundRadius;
+		return true;
+	}
+	virtual hitTestResult hitTest(const Ray& r)
+	{
+		if (bounded && missesBoundingSphere(r, boundCenter, boundRadius)) return hitTestResult{ false, 0.0, Vector4() };
+		// CIuWFNgԂɕϊ
+		// xNg͐KȂ̂ŁA͂̒Ŋă[hԂɖ߂
+		auto localDir = worldToObject.transform(r.getDirection());
+		localDir.w = 0;
+		auto scaling = localDir.length();
+		if (scaling == 0) return hitTestResult{ false, 0.0, Vector4() };
+		Ray localRay(worldToObject.transform(r.getStartPos()), localDir / scaling);
+
+		auto hitInfo = pGeometry->hitTest(localRay);
+		if (!hitInfo.hit) return hitTestResult{ false, hitInfo.hitRayPosition / scaling, Vector4() };
+
+		// @͋ts̓]uŕϊ
+		auto n = worldToObject.transpose().transform(Vector4(hitInfo.normal.x, hitInfo.normal.y, hitInfo.normal.z, 0.0));
+		n.w = 0;
+		return hitTestResult{ true, hitInfo.hitRayPosition / scaling, n.normalize() };
+	}
 };
@@ -0,0 +1,236 @@
+#pragma once
+
+#include <string>
+#include <atomic>
+#include <new>
+#include <Windows.h>
+#include "MathExt.h"
+
+// `撆̃t[𖼑OtLɌJ
+// \: [wb_][^CL^̃O][sNZ(Vector4, width * height)]
+// ݂̓_1vZX݂̂ŁAbN͎gȂ
+//  1. sNZ𒼐ڋLɏ
+//  2. Ő󂫃XbgɃ^C͈̔͂AXbgseqXV
+//  3. wb_tileSeqXV
+// r[AtileSeq̍Oǂ݁AXbgseqvȂ(ǂzꂽ)Ŝǂݒ
+
+struct SharedFrameHeader
+{
+	static const std::uint32_t Magic = 0x46325452;	// "RT2F"
+	static const std::uint32_t Version = 1;
+
+	std::uint32_t magic;
+	std::uint32_t version;
+	std::uint32_t width, height;
+	std::uint32_t ringSize;
+	std::uint32_t pixelOffset;
+	// `撆/`ς݂̃t[ԍƁAJ^C̗݌v
+	std::atomic<std::uint32_t> frameSeq;
+	std::atomic<std::uint32_t> completedFrameSeq;
+	std::atomic<std::uint32_t> tileSeq;
+};
+
+struct SharedTileRecord
+{
+	// ̃Xbgɏꂽ^C̒ʂԍ + 1(0͖gp)
+	std::atomic<std::uint32_t> seq;
+	std::uint32_t frame;
+	std::uint32_t x, y, width, height;
+};
+
+class SharedFrameBufferWriter
+{
+	HANDLE hMapping = nullptr;
+	std::uint8_t* pView = nullptr;
+	SharedFrameHeader* pHeader = nullptr;
+	SharedTileRecord* pRing = nullptr;
+public:
+	SharedFrameBufferWriter(){}
+	SharedFrameBufferWriter(const SharedFrameBufferWriter&) = delete;
+	SharedFrameBufferWriter& operator=(const SharedFrameBufferWriter&) = delete;
+	~SharedFrameBufferWriter()
+	{
+		close();
+	}
+
+	// ŐLɂ(ʂ̃_ĂA܂͑Õr[A܂JĂ)ꍇ͎s
+	// ̗̈͑傫Ȃ\Aǂłr[ẢŃwb_ƂɂȂ邽
+	bool open(const std::wstring& name, std::uint32_t w, std::uint32_t h, std::uint32_t ringSize = 256)
+	{
+		close();
+		// sNZ̈̓LbVCEɑ
+		auto pixelOffset = (sizeof(SharedFrameHeader) + sizeof(SharedTileRecord) * ringSize + 63) & ~std::size_t(63);
+		auto totalSize = std::uint64_t(pixelOffset) + std::uint64_t(w) * h * sizeof(Vector4);
+		hMapping = CreateFileMapping(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, DWORD(totalSize >> 32), DWORD(totalSize & 0xffffffff), name.c_str());
+		if (!hMapping) return false;
+		if (GetLastError() == ERROR_ALREADY_EXISTS)
+		{
+			close();
+			return false;
+		}
+		pView = static_cast<std::uint8_t*>(MapViewOfFile(hMapping, FILE_MAP_ALL_ACCESS, 0, 0, 0));
+		if (!pView)
+		{
+			close();
+			return false;
+		}
+		// mۂꂽ傫mF
+		MEMORY_BASIC_INFORMATION mbi;
+		if (VirtualQuery(pView, &mbi, sizeof mbi) == 0 || std::uint64_t(mbi.RegionSize) < totalSize)
+		{
+			close();
+			return false;
+		}
+
+		pHeader = new (pView) SharedFrameHeader;
+		pRing = reinterpret_cast<SharedTileRecord*>(pView + sizeof(SharedFrameHeader));
+		for (std::uint32_t i = 0; i < ringSize; i++)
+		{
+			new (pRing + i) SharedTileRecord;
+			pRing[i].seq.store(0, std::memory_order_relaxed);
+		}
+		pHeader->width = w;
+		pHeader->height = h;
+		pHeader->ringSize = ringSize;
+		pHeader->pixelOffset = std::uint32_t(pixelOffset);
+		pHeader->frameSeq.store(0, std::memory_order_relaxed);
+		pHeader->completedFrameSeq.store(0, std::memory_order_relaxed);
+		pHeader->tileSeq.store(0, std::memory_order_relaxed);
+		pHeader->version = SharedFrameHeader::Version;
+		// magic͍Ōɏ(r[A͂ďς݂ǂf)
+		std::atomic_thread_fence(std::memory_order_release);
+		pHeader->magic = SharedFrameHeader::Magic;
+		return true;
+	}
+	void close()
+	{
+		if (pView) UnmapViewOfFile(pView);
+		if (hMapping) CloseHandle(hMapping);
+		pView = nullptr;
+		hMapping = nullptr;
+		pHeader = nullptr;
+		pRing = nullptr;
+	}
+	bool isOpen() const { return pView != nullptr; }
+
+	// _͂֒ڏ(ColorBuffer::attach)
+	Vector4* getPixels() const { return reinterpret_cast<Vector4*>(pView + pHeader->pixelOffset); }
+
+	void beginFrame()
+	{
+		pHeader->frameSeq.fetch_add(1, std::memory_order_release);
+	}
+	void publishTile(std::uint32_t x, std::uint32_t y, std::uint32_t w, std::uint32_t h)
+	{
+		auto n = pHeader->tileSeq.load(std::memory_order_relaxed);
+		auto& slot = pRing[n % pHeader->ringSize];
+		// seq0ɂĂ
+		slot.seq.store(0, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		slot.frame = pHeader->frameSeq.load(std::memory_order_relaxed);
+		slot.x = x;
+		slot.y = y;
+		slot.width = w;
+		slot.height = h;
+		slot.seq.store(n + 1, std::memory_order_release);
+		pHeader->tileSeq.store(n + 1, std::memory_order_release);
+	}
+	void endFrame()
+	{
+		pHeader->completedFrameSeq.store(pHeader->frameSeq.load(std::memory_order_relaxed), std::memory_order_release);
+	}
+};
+
+class SharedFrameBufferReader
+{
+	HANDLE hMapping = nullptr;
+	const std::uint8_t* pView = nullptr;
+	const SharedFrameHeader* pHeader = nullptr;
+	const SharedTileRecord* pRing = nullptr;
+	std::uint32_t lastTileSeq = 0;
+public:
+	SharedFrameBufferReader(){}
+	SharedFrameBufferReader(const SharedFrameBufferReader&) = delete;
+	SharedFrameBufferReader& operator=(const SharedFrameBufferReader&) = delete;
+	~SharedFrameBufferReader()
+	{
+		close();
+	}
+
+	bool open(const std::wstring& name)
+	{
+		close();
+		hMapping = OpenFileMapping(FILE_MAP_READ, false, name.c_str());
+		if (!hMapping) return false;
+		pView = static_cast<const std::uint8_t*>(MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0));
+		if (!pView)
+		{
+			CloseHandle(hMapping);
+			hMapping = nullptr;
+			return false;
+		}
+		pHeader = reinterpret_cast<const SharedFrameHeader*>(pView);
+		if (pHeader->magic != SharedFrameHeader::Magic || pHeader->version != SharedFrameHeader::Version)
+		{
+			close();
+			return false;
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		pRing = reinterpret_cast<const SharedTileRecord*>(pView + sizeof(SharedFrameHeader));
+		lastTileSeq = 0;
+		return true;
+	}
+	void close()
+	{
+		if (pView) UnmapViewOfFile(pView);
+		if (hMapping) CloseHandle(hMapping);
+		pView = nullptr;
+		hMapping = nullptr;
+		pHeader = nullptr;
+		pRing = nullptr;
+	}
+
+	std::uint32_t getWidth() const { return pHeader->width; }
+	std::uint32_t getHeight() const { return pHeader->height; }
+	std::uint32_t getFrameSeq() const { return pHeader->frameSeq.load(std::memory_order_acquire); }
+	std::uint32_t getCompletedFrameSeq() const { return pHeader->completedFrameSeq.load(std::memory_order_acquire); }
+	const Vector4* getPixels() const { return reinterpret_cast<const Vector4*>(pView + pHeader->pixelOffset); }
+
+	// O񂩂VJꂽ^ConTile(record)Œʒm
+	// 肱ڂꍇfalseԂ̂ŁAĂяo͑Ŝǂݒ
+	template<typename FuncT> bool poll(FuncT onTile)
+	{
+		auto current = pHeader->tileSeq.load(std::memory_order_acquire);
+		bool complete = true;
+		if (current - lastTileSeq > pHeader->ringSize)
+		{
+			complete = false;
+			lastTileSeq = current - pHeader->ringSize;
+		}
+		for (; lastTileSeq != current; lastTileSeq++)
+		{
+			const auto& slot = pRing[lastTileSeq % pHeader->ringSize];
+			if (slot.seq.load(std::memory_order_acquire) != lastTileSeq + 1)
+			{
+				complete = false;
+				continue;
+			}
+			SharedTileRecord record;
+			record.frame = slot.frame;
+			record.x = slot.x;
+			record.y = slot.y;
+			record.width = slot.width;
+			record.height = slot.height;
+			std::atomic_thread_fence(std::memory_order_acquire);
+			// ǂłԂɏ㏑ĂȂmF
+			if (slot.seq.load(std::memory_order_relaxed) != lastTileSeq + 1)
+			{
+				complete = false;
+				continue;
+			}
+			record.seq.store(lastTileSeq + 1, std::memory_order_relaxed);
+			onTile(record);
+		}
+		return complete;
+	}
+};
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <limits>
+#include "MathExt.h"
+#include "ColorBuffer.h"
+
+#include <png.h>
+
+class ITexture
+{
+public:
+	virtual ~ITexture(){}
+
+	// uv: eNX`W(JԂ)Afootprint: 1sNZUVԂŐ߂镝
+	virtual Vector4 sample(const Vector4& uv, float footprint) = 0;
+};
+
+// eNZ32x32̃^CPʂMorton(Z-order)ɕׁA~bv}bvOɍĂ
+// eNX`͈̂ꎟC̏Փ˓_̐F(getSurfaceColor)݂̂ŁAAO̍ċÂ͕̐F̂܂܎g
+// ChannelTstd::uint8_tstd::uint16_t
+template<typename ChannelT>
+class MortonTexture : public ITexture
+{
+	static const std::uint32_t TileShift = 5;
+	static const std::uint32_t TileSize = 1 << TileShift;
+
+	struct Texel { ChannelT r, g, b, a; };
+	struct MipLevel
+	{
+		std::uint32_t width, height, tilesX;
+		std::vector<Texel> texels;
+	};
+	std::vector<MipLevel> levels;
+
+	static std::uint32_t part1by1(std::uint32_t v)
+	{
+		// ʃrbg̊Ԃ0
+		v &= 0x0000ffff;
+		v = (v | (v << 8)) & 0x00ff00ff;
+		v = (v | (v << 4)) & 0x0f0f0f0f;
+		v = (v | (v << 2)) & 0x33333333;
+		v = (v | (v << 1)) & 0x55555555;
+		return v;
+	}
+	static std::size_t texelIndex(const MipLevel& lv, std::uint32_t x, std::uint32_t y)
+	{
+		auto tile = (y >> TileShift) * lv.tilesX + (x >> TileShift);
+		return tile * (TileSize * TileSize) + (part1by1(x & (TileSize - 1)) | (part1by1(y & (TileSize - 1)) << 1));
+	}
+	static float toFloat(ChannelT v) { return float(v) / float(std::numeric_limits<ChannelT>::max()); }
+	static ChannelT fromFloat(float v) { return ChannelT(clamp(v, 0.0f, 1.0f) * std::numeric_limits<ChannelT>::max() + 0.5f); }
+
+	void initLevel(MipLevel& lv, std::uint32_t w, std::uint32_t h)
+	{
+		lv.width = w;
+		lv.height = h;
+		lv.tilesX = (w + TileSize - 1) >> TileShift;
+		auto tilesY = (h + TileSize - 1) >> TileShift;
+		lv.texels.resize(std::size_t(lv.tilesX) * tilesY * TileSize * TileSize);
+	}
+	void store(MipLevel& lv, std::uint32_t x, std::uint32_t y, const Vector4& c)
+	{
+		lv.texels[texelIndex(lv, x, y)] = Texel{ fromFloat(c.r), fromFloat(c.g), fromFloat(c.b), fromFloat(c.a) };
+	}
+	Vector4 fetch(const MipLevel& lv, std::int32_t x, std::int32_t y) const
+	{
+		// JԂ
+		x %= std::int32_t(lv.width); if (x < 0) x += lv.width;
+		y %= std::int32_t(lv.height); if (y < 0) y += lv.height;
+		const auto& t = lv.texels[texelIndex(lv, x, y)];
+		return Vector4(toFloat(t.r), toFloat(t.g), toFloat(t.b), toFloat(t.a));
+	}
+	Vector4 sampleLevel(const MipLevel& lv, const Vector4& uv) const
+	{
+		// eNZSɐ`
+		auto px = uv.x * lv.width - 0.5f;
+		auto py = uv.y * lv.height - 0.5f;
+		auto fx = floor(px), fy = floor(py);
+		auto xd = px - fx, yd = py - fy;
+		auto x = std::int32_t(fx), y = std::int32_t(fy);
+		auto t = fetch(lv, x, y) * (1.0f - xd) + fetch(lv, x + 1, y) * xd;
+		auto b = fetch(lv, x, y + 1) * (1.0f - xd) + fetch(lv, x + 1, y + 1) * xd;
+		return t * (1.0f - yd) + b * yd;
+	}
+public:
+	MortonTexture(ColorBuffer& source)
+	{
+		std::uint32_t w = source.getWidth(), h = source.getHeight();
+		levels.emplace_back();
+		initLevel(levels.back(), w, h);
+#pragma omp parallel for
+		for (std::int32_t y = 0; y < std::int32_t(h); y++)
+		{
+			for (std::uint32_t x = 0; x < w; x++) store(levels.back(), x, y, source.get(Vector4(x, y)));
+		}
+
+		// 2x2̕ςŏkĂ(̕/ł͗]Ō̗/sŌ̃eNZɊ܂߂)
+		while (w > 1 || h > 1)
+		{
+			auto nw = max<std::uint32_t>(w / 2, 1), nh = max<std::uint32_t>(h / 2, 1);
+			levels.emplace_back();
+			const auto& src = levels[levels.size() - 2];
+			auto& dst = levels.back();
+			initLevel(dst, nw, nh);
+#pragma omp parallel for
+			for (std::int32_t y = 0; y < std::int32_t(nh); y++)
+			{
+				std::uint32_t y0 = y * 2, y1 = std::uint32_t(y) + 1 == nh ? h : y0 + 2;
+				for (std::uint32_t x = 0; x < nw; x++)
+				{
+					std::uint32_t x0 = x * 2, x1 = x + 1 == nw ? w : x0 + 2;
+					Vector4 c;
+					for (auto sy = y0; sy < y1; sy++)
+					{
+						for (auto sx = x0; sx < x1; sx++) c = c + fetch(src, sx, sy);
+					}
+					store(dst, x, y, c / float((x1 - x0) * (y1 - y0)));
+				}
+			}
+			w = nw;
+			h = nh;
+		}
+	}
+	virtual ~MortonTexture(){}
+
+	std::uint32_t getWidth() const { return levels[0].width; }
+	std::uint32_t getHeight() const { return levels[0].height; }
+	std::size_t getLevelCount() const { return levels.size(); }
+
+	virtual Vector4 sample(const Vector4& uv, float footprint)
+	{
+		// footprintő𑜓x̃eNZɂă~bvx߂(xԂ͐`)
+		auto texels = footprint * max(levels[0].width, levels[0].height);
+		auto lod = texels > 1.0f ? float(log2(texels)) : 0.0f;
+		auto maxLevel = float(levels.size() - 1);
+		if (lod >= maxLevel) return sampleLevel(levels.back(), uv);
+		auto lv = std::uint32_t(lod);
+		auto ld = lod - lv;
+		if (ld == 0.0f) return sampleLevel(levels[lv], uv);
+		return sampleLevel(levels[lv], uv) * (1.0f - ld) + sampleLevel(levels[lv + 1], uv) * ld;
+	}
+};
+
+typedef MortonTexture<std::uint8_t> Texture8;
+typedef MortonTexture<std::uint16_t> Texture16;
+
+// PNGǂݍŃrbg[xɍ킹eNX`
+inline ITexture* LoadTexture(const std::wstring& fileName)
+{
+	FILE* fp = nullptr;
+	if (_wfopen_s(&fp, fileName.c_str(), L"rb") != 0) return nullptr;
+
+	// G[longjmpłɖ߂̂ŁAfXgN^ϐsetjmpOɍĂ
+	// (setjmpɍlongjmpŃfXgN^΂)
+	std::vector<png_byte> pixels;
+	std::vector<png_bytep> rows;
+	auto pp = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+	auto ip = png_create_info_struct(pp);
+	if (setjmp(png_jmpbuf(pp)))
+	{
+		png_destroy_read_struct(&pp, &ip, nullptr);
+		fclose(fp);
+		return nullptr;
+	}
+
+	png_init_io(pp, fp);
+	png_read_info(pp, ip);
+	auto width = png_get_image_width(pp, ip);
+	auto height = png_get_image_height(pp, ip);
+	auto is16 = png_get_bit_depth(pp, ip) == 16;
+	// RGBAɑ
+	png_set_expand(pp);
+	png_set_gray_to_rgb(pp);
+	png_set_add_alpha(pp, is16 ? 0xffff : 0xff, PNG_FILLER_AFTER);
+	if (is16) png_set_swap(pp);
+	png_read_update_info(pp, ip);
+
+	auto rowBytes = png_get_rowbytes(pp, ip);
+	pixels.resize(rowBytes * height);
+	rows.resize(height);
+	for (std::uint32_t i = 0; i < height; i++) rows[i] = pixels.data() + (i * rowBytes);
+	png_read_image(pp, rows.data());
+	png_read_end(pp, nullptr);
+	png_destroy_read_struct(&pp, &ip, nullptr);
+	fclose(fp);
+
+	ColorBuffer source(width, height);
+#pragma omp parallel for
+	for (std::int32_t y = 0; y < std::int32_t(height); y++)
+	{
+		for (std::uint32_t x = 0; x < width; x++)
+		{
+			if (is16)
+			{
+				auto p = reinterpret_cast<const std::uint16_t*>(rows[y]) + x * 4;
+				source.set(Vector4(x, y), Vector4(p[0], p[1], p[2], p[3]) / 65535.0f);
+			}
+			else
+			{
+				auto p = rows[y] + x * 4;
+				source.set(Vector4(x, y), Vector4(p[0], p[1], p[2], p[3]) / 255.0f);
+			}
+		}
+	}
+
+	if (is16) return new Texture16(source);
+	return new Texture8(source);
+}
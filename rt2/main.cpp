@@ -8,6 +8,7 @@
 #include <Windows.h>
 #include <mmsystem.h>
 #include <iomanip>
+#include <fstream>
 
 #undef max
 #undef min
@@ -15,6 +16,10 @@
 #include "MathExt.h"
 #include "Objects.h"
 #include "ColorBuffer.h"
+#include "SharedFrameBuffer.h"
+#include "Instrumentation.h"
+#include "LayeredImage.h"
+#include "ImageMetrics.h"
 
 #pragma comment(lib, "winmm")
 #pragma comment(lib, "libpng16")
@@ -24,6 +29,9 @@ namespace SceneInfo
 	std::vector<IObjectBase*> SceneObjects;
 
 	void init();
+	// x`}[Np̌ŒV[(OԂ)
+	const std::uint32_t TestSceneCount = 2;
+	const char* initTestScene(std::uint32_t index);
 }
 
 namespace FrameInfo
@@ -33,14 +41,173 @@ namespace FrameInfo
 	const int ambientCalcCount = 1;
 	const std::uint32_t ambientSampleCount = 8;
 	const double ambientDistance = 1.0;
+	const double sphereOcclusionRange = 16.0;
 
 	const double hfov = 90.0;
 
+	// 0ȊOȂ(band)Pʂŕ`悵Čʂ𒀎t@C֏o(ƃ̏[byte])
+	// o͉𑜓xɊ֌WȂgpʂ}
+	const std::uint64_t bandMemoryBudget = 0;
+	// FXAAQƂ㉺̗]s
+	const std::uint32_t bandHalo = 8;
+	// t[obt@Ƀ[Wy[Wg(SeLockMemoryPrivilegeKv)
+	const bool useLargePages = false;
+
+	// `撆̃t[LɌJ(nullptrȂ疳)
+	// headlessȂEBhEoɏI(\͕ʃvZX̃r[Aōs)
+	const wchar_t* const sharedFrameBufferName = L"Local\\rt2_framebuffer";
+	const bool headless = false;
+
+	// AOV܂Ƃ߂1̑wt@C(OpenEXR)ɏo(Nvhalf/floatŊi[)
+	const wchar_t* const layeredImageName = L"layers.exr";
+	const LayeredImageCompression layeredImageCompression = LayeredImageCompression::RLE;
+	// 8bitPNGłʂɏo
+	const bool exportPortableNetworkGraphs = true;
+
+	// KIX[p[TvOŋEƂ݂Ȃ1/[x̒i(Βl)Ɩ@̓
+	const float adaptiveDepthThreshold = 0.02f;
+	const float adaptiveNormalThreshold = 0.9f;
+
+	// vLV`AOԂƂAʂƂ݂Ȃ[x̍(Βl)Ɩ@̈vx̉s
+	const float proxyDepthTolerance = 0.05f;
+	const float proxyNormalPower = 16.0f;
+
+	// x`}[N(--benchmark)
+	// eXgV[ƂɍTv̎QƉ摜(t@CɕۑĎ񂩂g)Aeݒŕ`JԂĕςȂ
+	// oߎԂƂ̎QƉ摜Ƃ̌덷(final, ao_factorRMSE/SSIM)benchmark.csvɏ
+	// 1񕪂̕`悪Ԃ̏𒴂Ȃ悤ɁA1/benchmarkScalẻ𑜓xŕ`悷(S̕`ƓJŁAubN̒Sʂ郌C)
+	struct BenchmarkConfig
+	{
+		const char* name;
+		std::uint32_t ambientSampleCount;
+		int ambientCalcCount;
+	};
+	const BenchmarkConfig benchmarkConfigs[] =
+	{
+		{ "samples2", 2, 1 },
+		{ "samples4", 4, 1 },
+		{ "samples8", 8, 1 },
+		{ "samples4_nobounce", 4, 0 },
+	};
+	// QƉ摜1̈ݒ𒷎(ݒ育Ƃ̏10{AŒbenchmarkReferenceMinPasses)JԂĕς
+	// AÕTv͖ƗȗŁAʂ͂̒PςȂ̂ŊҒl̓TvɂȂ(n̕ς̓Tv𑝂₵̂ƓlɎ)
+	// ċAł̓Tv4ŃĈŁATv𑝂₷񐔂d˂
+	// ċA񐔂͌vݒƓ1ɂ(₷ƕʂ̐ϕɂȂAǂ̐ݒQƉ摜ɎȂȂ)
+	// ̎Օ--analytic-spheresɂ炸ɃCŋ߂(ߎ̌덷vɊ܂߂)
+	const BenchmarkConfig benchmarkReference = { "reference", 4, 1 };
+	// QƉ摜̃t@C`AAǑvZeXgV[ςƂグ(ÂLbVgȂ悤)
+	const std::uint32_t benchmarkReferenceVersion = 2;
+	const double benchmarkReferenceBudget = 600.0;
+	const std::uint32_t benchmarkReferenceMinPasses = 8;
+	const std::uint32_t benchmarkScale = 4;
+	// ݒ育Ƃ̕`掞Ԃ̏[s]
+	const double benchmarkTimeBudget = 60.0;
+	// `ƕς̍XVbenchmarkBlockRowsssAŏ1񕪂Ă͌oߎԂbenchmarkCheckpointRatio{ɂȂ邲ƂɌ덷L^
+	// (1񕪂̕`悪xݒłԂƂ̋Ȑ)
+	const std::uint32_t benchmarkBlockRows = 8;
+	const double benchmarkCheckpointRatio = 1.1;
+
 	ColorBuffer final_buffer;
+	SharedFrameBufferWriter sharedFrame;
+	ProgressReporter progress;
+
+	struct CameraInfo
+	{
+		Vector4 focalPoint;
+		double aspectValue;
+		double pixelSpread;
+	};
+	struct RenderTargets
+	{
+		ColorBuffer* diffuse;
+		ColorBuffer* normal;
+		ColorBuffer* depth;
+		ColorBuffer* aoFactor;
+		ColorBuffer* final;
+		// vp(Instrumentation::EnabledłȂnullptr)
+		ColorBuffer* cost;
+		// ̂̔ԍ(SceneObjects̓Y + 1Awi0)AnullptrȂ珑Ȃ
+		ColorBuffer* objectId;
+	};
+
+	// o͂AOV(final͏ɏo͂)
+	enum AOVFlags : std::uint32_t
+	{
+		AOVDiffuse = 1 << 0,
+		AOVNormal = 1 << 1,
+		AOVDepth = 1 << 2,
+		AOVAmbient = 1 << 3,
+		AOVAll = AOVDiffuse | AOVNormal | AOVDepth | AOVAmbient,
+		// ėpJ[lp(`悪mۂĂAOVsɌ)
+		AOVRuntime = 1u << 31
+	};
+	// `J[l̎sݒ(R}hCŕύXł)
+	// vꉻς݃J[l΂AȂΔėpJ[lg
+	struct KernelConfig
+	{
+		std::uint32_t ambientSampleCount;
+		int ambientCalcCount;
+		std::uint32_t aovs;
+	};
+	KernelConfig kernelConfig = { FrameInfo::ambientSampleCount, FrameInfo::ambientCalcCount, AOVAll };
+	inline bool aovEnabled(std::uint32_t flag) { return (kernelConfig.aovs & flag) != 0; }
+	// aovsŖAOV̕`nullptrɂ(J[l͏Ȃ̂ŊmۂȂĂ悢)
+	inline ColorBuffer* aovTarget(ColorBuffer& buffer, std::uint32_t aovs, std::uint32_t flag) { return (aovs & flag) ? &buffer : nullptr; }
+	// `悪mۂĂAOV(ĂяoselectKernelɓnaovsɍ킹Ċmۂ)
+	inline std::uint32_t targetAOVs(const RenderTargets& targets)
+	{
+		return (targets.diffuse ? AOVDiffuse : 0) | (targets.normal ? AOVNormal : 0) | (targets.depth ? AOVDepth : 0) | (targets.aoFactor ? AOVAmbient : 0);
+	}
+	// (x, y)̃sNZ`悵targets(targetX, targetY)ɏ
+	typedef void(*PixelKernel)(const CameraInfo& camera, double x, double y, double targetX, double targetY, const RenderTargets& targets);
+
+	// `(--crop left,top,width,height)ƃvLV`(--proxy N: 1/N̉𑜓x)
+	// ǂS̕`ƓJĝŁAʂ͑S̕`̓ʒuƈv
+	struct RenderRegion
+	{
+		std::uint32_t left, top, width, height;
+	};
+	RenderRegion cropRegion = { 0, 0, 0, 0 };
+	std::uint32_t proxyScale = 0;
+	// KIX[p[TvO(--adaptive N)
+	// ́A[xA@ׂƕςsNZN x N{̑wTvŕ`悵(LȂFXAA͎gȂ)
+	std::uint32_t adaptiveSampleGrid = 0;
+	bool benchmark = false;
+	// ɂՕ̓C΂ɉ͓Iɋ߂(--analytic-spheres)
+	// ̏ƂԂ͏W߂AAÕC͋fʂ肷̂Ŋ̏o͂Ƃ͕ς(̑V[)
+	bool analyticSphereOcclusion = false;
+
+	// ƍŏɏՓ˂(pObjectnullptrȂwi)
+	struct PrimaryHit
+	{
+		Ray eyeRay;
+		hitTestResult info;
+		IObjectBase* pObject;
+		// SceneObjects̓Y + 1
+		std::uint32_t objectIndex;
+
+		PrimaryHit(const Ray& r) : eyeRay(r), pObject(nullptr), objectIndex(0) {}
+	};
 
 	HBITMAP hBuffer = nullptr, hReservedBitmap;
 	HDC hRenderContext = nullptr;
+	bool parseCommandLine(int argc, char** argv);
+	PixelKernel selectKernel(const KernelConfig& config);
+	CameraInfo setupCamera();
+	PrimaryHit tracePrimary(const CameraInfo& camera, double x, double y);
+	Vector4 shadeSurface(const CameraInfo& camera, const PrimaryHit& primary, const Vector4& targetPos, const RenderTargets& targets, std::uint32_t aovs);
+	// SampleCountT0ADepthTȂkernelConfig̒lAAOVsTAOVRuntimeȂ`悪mۂĂAOVg
+	template<std::uint32_t SampleCountT, int DepthT, std::uint32_t AOVsT>
+	void tracePixel(const CameraInfo& camera, double x, double y, double targetX, double targetY, const RenderTargets& targets);
+	// ꎟĈ(diffuse, normal, depth)
+	void traceGeometry(const CameraInfo& camera, double x, double y, double targetX, double targetY, const RenderTargets& targets);
+	std::uint32_t supersampleEdges(const CameraInfo& camera, PixelKernel kernel, const RenderTargets& targets, std::uint32_t originX, std::uint32_t originY);
+	void exportResults(const RenderTargets& targets, const std::wstring& prefix);
 	void render();
+	void renderBanded();
+	void renderCrop(const RenderRegion& region);
+	void renderProxy(std::uint32_t scale);
+	void runBenchmark();
 }
 
 namespace Window
@@ -51,20 +218,90 @@ namespace Window
 	LRESULT CALLBACK WndProc(HWND, UINT, WPARAM, LPARAM);
 }
 
+template<std::uint32_t SampleCountT, int DepthT>
 Vector4 CalcateAmbient(const hitTestResult& htres, const Ray& ray, IObjectBase* processingObjectFrom, const int StepCounter);
 
+int WatchSharedFrameBuffer();
+
 int main(int argc, char** argv)
 {
 	// raytracer 2
 	
+	if (argc > 1 && std::string(argv[1]) == "--watch") return WatchSharedFrameBuffer();
+	if (!FrameInfo::parseCommandLine(argc, argv)) return -1;
+
 	std::cout << "Raytracer 2" << std::endl;
 	std::cout << "Render Frame Size:(" << FrameInfo::width << ", " << FrameInfo::height << ")" << std::endl;
+	if (!FrameBufferPool::instance().setLargePages(FrameInfo::useLargePages))
+	{
+		std::cout << "large pages are unavailable(SeLockMemoryPrivilege is not granted), using normal pages" << std::endl;
+	}
+	if (FrameInfo::benchmark)
+	{
+		FrameInfo::runBenchmark();
+		return 0;
+	}
 	SceneInfo::init();
+	if (FrameInfo::cropRegion.width > 0 && FrameInfo::cropRegion.height > 0)
+	{
+		FrameInfo::renderCrop(FrameInfo::cropRegion);
+		return 0;
+	}
+	// KIX[p[TvO͑S̕`Ɛ؂o`̂(vLVƑѕłFXAAg)
+	if (FrameInfo::adaptiveSampleGrid > 1 && (FrameInfo::proxyScale > 1 || FrameInfo::bandMemoryBudget > 0))
+	{
+		std::cout << "--adaptive is not supported with " << (FrameInfo::proxyScale > 1 ? "--proxy" : "band rendering") << ", using FXAA" << std::endl;
+	}
+	if (FrameInfo::proxyScale > 1)
+	{
+		FrameInfo::renderProxy(FrameInfo::proxyScale);
+		return 0;
+	}
+	if (FrameInfo::bandMemoryBudget > 0)
+	{
+		FrameInfo::renderBanded();
+		return 0;
+	}
 	FrameInfo::render();
-	Window::show();
+	if (!FrameInfo::headless) Window::show();
 	return 0;
 }
 
+int WatchSharedFrameBuffer()
+{
+	// L̃t[obt@ĎeXgpNCAg
+	// Jꂽ^C\At[live.pngɏoďI
+	SharedFrameBufferReader reader;
+	std::cout << "waiting for renderer..." << std::endl;
+	while (!reader.open(FrameInfo::sharedFrameBufferName)) Sleep(100);
+	std::cout << "Frame Size:(" << reader.getWidth() << ", " << reader.getHeight() << ")" << std::endl;
+
+	auto startFrame = reader.getFrameSeq();
+	while (true)
+	{
+		auto complete = reader.poll([](const SharedTileRecord& tile)
+		{
+			std::cout << "frame " << tile.frame << " tile #" << tile.seq << ": (" << tile.x << ", " << tile.y << ") " << tile.width << "x" << tile.height << std::endl;
+		});
+		if (!complete) std::cout << "missed some tiles, whole frame should be refreshed" << std::endl;
+
+		auto completed = reader.getCompletedFrameSeq();
+		if (completed != 0 && completed >= startFrame)
+		{
+			ColorBuffer live(reader.getWidth(), reader.getHeight());
+			auto pPixels = reader.getPixels();
+			for (std::uint32_t y = 0; y < reader.getHeight(); y++)
+			{
+				for (std::uint32_t x = 0; x < reader.getWidth(); x++) live.set(Vector4(x, y), pPixels[y * reader.getWidth() + x]);
+			}
+			live.ExportPortableNetworkGraph(L"live.png");
+			std::cout << "frame " << completed << " completed" << std::endl;
+			return 0;
+		}
+		Sleep(50);
+	}
+}
+
 void SceneInfo::init()
 {
 	SceneInfo::SceneObjects.clear();
@@ -84,6 +321,356 @@ void SceneInfo::init()
 	SceneInfo::SceneObjects.push_back(new Sphere(Vector4(0.0, 0.0, 5.0, 1.0), Vector4(1.0, 0.0, 0.0, 1.0), 1.0));
 	SceneInfo::SceneObjects.push_back(new Sphere(Vector4(0.5, 0.0, 6.0, 1.0), Vector4(0.0, 1.0, 0.0, 1.0), 1.0));
 	SceneInfo::SceneObjects.push_back(new Sphere(Vector4(-1.0, 0.0, 4.0, 1.0), Vector4(0.0, 1.0, 1.0, 1.0), 1.0));
+
+	// eNX`
+	//SceneInfo::SceneObjects[3]->setTexture(LoadTexture(L"texture.png"));
+
+	// CX^VO: LWIgAtBϊŔzu
+	//auto pCluster = new ObjectGroup(Vector4(0.0, 0.0, 0.0, 1.0), Vector4(1.0, 1.0, 1.0, 1.0));
+	//pCluster->add(new Sphere(Vector4(0.0, 0.0, 0.0, 1.0), Vector4(1.0, 1.0, 1.0, 1.0), 0.25));
+	//pCluster->add(new Sphere(Vector4(0.4, 0.0, 0.0, 1.0), Vector4(1.0, 1.0, 1.0, 1.0), 0.15));
+	//for (int i = 0; i < 8; i++)
+	//{
+	//	auto xf = Matrix4::translate(Vector4(-1.75 + i * 0.5, -2.25, 3.0)) * Matrix4::rotY(i * 45.0f);
+	//	SceneInfo::SceneObjects.push_back(new Instance(pCluster, xf, Vector4(1.0, 1.0, 0.0, 1.0)));
+	//}
+}
+
+const char* SceneInfo::initTestScene(std::uint32_t index)
+{
+	SceneInfo::init();
+	if (index == 0) return "default";
+
+	// ̋߂ɏȋׂ(Ԃ̎ՕV[)
+	auto pCluster = new ObjectGroup(Vector4(0.0, 0.0, 0.0, 1.0), Vector4(1.0, 1.0, 1.0, 1.0));
+	pCluster->add(new Sphere(Vector4(0.0, 0.0, 0.0, 1.0), Vector4(1.0, 1.0, 1.0, 1.0), 0.25));
+	pCluster->add(new Sphere(Vector4(0.4, 0.0, 0.0, 1.0), Vector4(1.0, 1.0, 1.0, 1.0), 0.15));
+	for (int i = 0; i < 8; i++)
+	{
+		auto xf = Matrix4::translate(Vector4(-1.75 + i * 0.5, -2.25, 3.0)) * Matrix4::rotY(i * 45.0f);
+		SceneInfo::SceneObjects.push_back(new Instance(pCluster, xf, Vector4(1.0, 1.0, 0.0, 1.0)));
+	}
+	return "cluster";
+}
+
+FrameInfo::CameraInfo FrameInfo::setupCamera()
+{
+	CameraInfo camera;
+	double focalLength = 1 / tan((FrameInfo::hfov / 2.0) * (M_PI / 180.0));
+	std::cout << "focal length:" << focalLength << std::endl;
+	camera.focalPoint = Vector4(0.0, 0.0, -focalLength, 1.0);
+	camera.aspectValue = double(FrameInfo::height) / double(FrameInfo::width);
+	std::cout << "aspect value:" << camera.aspectValue << std::endl;
+	// 1Pʂ1sNZ̕(eNX`̃~bvxIp)
+	camera.pixelSpread = 2.0 / (FrameInfo::width * focalLength);
+	return camera;
+}
+
+// --samples N: AÕTv(N * N{), --bounces N: AO̍ċA, --aovs diffuse,normal,depth,ao|all|none
+// --crop left,top,width,height: w͈͂̂ݕ`, --proxy N: 1/N̉𑜓xŕ`悵ĕ
+// --adaptive N: ẼsNẐN x N{ŃX[p[TvO
+// --benchmark: x`}[N, --analytic-spheres: ɂՕ͓Iɋ߂
+bool FrameInfo::parseCommandLine(int argc, char** argv)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg(argv[i]);
+		if (arg == "--benchmark")
+		{
+			benchmark = true;
+			continue;
+		}
+		if (arg == "--analytic-spheres")
+		{
+			analyticSphereOcclusion = true;
+			continue;
+		}
+		if (i + 1 >= argc)
+		{
+			std::cout << "missing value for " << arg << std::endl;
+			return false;
+		}
+		std::string value(argv[++i]);
+		if (arg == "--samples") kernelConfig.ambientSampleCount = std::uint32_t(max(std::atoi(value.c_str()), 1));
+		else if (arg == "--bounces") kernelConfig.ambientCalcCount = max(std::atoi(value.c_str()), 0);
+		else if (arg == "--aovs")
+		{
+			kernelConfig.aovs = 0;
+			std::size_t begin = 0;
+			while (begin <= value.size())
+			{
+				auto end = min(value.find(',', begin), value.size());
+				auto name = value.substr(begin, end - begin);
+				if (name == "diffuse") kernelConfig.aovs |= AOVDiffuse;
+				else if (name == "normal") kernelConfig.aovs |= AOVNormal;
+				else if (name == "depth") kernelConfig.aovs |= AOVDepth;
+				else if (name == "ao") kernelConfig.aovs |= AOVAmbient;
+				else if (name == "all") kernelConfig.aovs |= AOVAll;
+				else if (name != "none")
+				{
+					std::cout << "unknown aov: " << name << std::endl;
+					return false;
+				}
+				begin = end + 1;
+			}
+		}
+		else if (arg == "--crop")
+		{
+			unsigned int l, t, w, h;
+			if (sscanf_s(value.c_str(), "%u,%u,%u,%u", &l, &t, &w, &h) != 4)
+			{
+				std::cout << "invalid crop region: " << value << std::endl;
+				return false;
+			}
+			cropRegion.left = l;
+			cropRegion.top = t;
+			cropRegion.width = w;
+			cropRegion.height = h;
+		}
+		else if (arg == "--proxy") proxyScale = std::uint32_t(max(std::atoi(value.c_str()), 1));
+		else if (arg == "--adaptive") adaptiveSampleGrid = std::uint32_t(max(std::atoi(value.c_str()), 0));
+		else
+		{
+			std::cout << "unknown option: " << arg << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+FrameInfo::PrimaryHit FrameInfo::tracePrimary(const CameraInfo& camera, double x, double y)
+{
+	// ɍsقz傫Ȃ
+	// オ}CiX
+	Vector4 surfacePos((x / FrameInfo::width) * 2.0 - 1.0, ((y / FrameInfo::height) * 2.0 - 1.0) * camera.aspectValue, 0.0, 1.0);
+	Vector4 eyeVector = surfacePos - camera.focalPoint;
+	eyeVector.w = 0;
+	//std::cout << surfacePos << " - " << focalPoint << " = " << eyeVector << std::endl;
+	PrimaryHit primary(Ray(camera.focalPoint, eyeVector.normalize()));
+	//std::cout << "eyeRay:" << eyeRay << std::endl;
+	RT2_COUNT_RAY();
+
+	auto depth = std::numeric_limits<double>::max();
+	for (std::uint32_t i = 0; i < SceneInfo::SceneObjects.size(); i++)
+	{
+		RT2_COUNT_HITTEST();
+		auto hitInfo = SceneInfo::SceneObjects[i]->hitTest(primary.eyeRay);
+		if (hitInfo.hit && depth > hitInfo.hitRayPosition)
+		{
+			depth = hitInfo.hitRayPosition;
+			primary.info = hitInfo;
+			primary.pObject = SceneInfo::SceneObjects[i];
+			primary.objectIndex = i + 1;
+		}
+	}
+	return primary;
+}
+
+// \ʂ̐F߁AaovsŎw肳ꂽGobt@
+inline Vector4 FrameInfo::shadeSurface(const CameraInfo& camera, const PrimaryHit& primary, const Vector4& targetPos, const RenderTargets& targets, std::uint32_t aovs)
+{
+	const auto& htinfo = primary.info;
+	auto hitPos = primary.eyeRay.Pos(htinfo.hitRayPosition);
+	auto baseColor = primary.pObject->getSurfaceColor(hitPos, htinfo.hitRayPosition * camera.pixelSpread);
+	if (aovs & AOVDiffuse) targets.diffuse->set(targetPos, baseColor);
+	if (aovs & AOVNormal) targets.normal->set(targetPos, (htinfo.normal + 1.0f) * 0.5f);
+	if (aovs & AOVDepth) targets.depth->set(targetPos, (hitPos + htinfo.normal * std::numeric_limits<float>::epsilon()).z / 15.0f);
+	if (targets.objectId) targets.objectId->set(targetPos, Vector4(float(primary.objectIndex)));
+	return baseColor;
+}
+
+template<std::uint32_t SampleCountT, int DepthT, std::uint32_t AOVsT>
+void FrameInfo::tracePixel(const CameraInfo& camera, double x, double y, double targetX, double targetY, const RenderTargets& targets)
+{
+	// ꉻꂽJ[lł͒萔ɂȂ̂ŁAo͂ȂAOV̏͏
+	const std::uint32_t aovs = (AOVsT & AOVRuntime) ? FrameInfo::targetAOVs(targets) : AOVsT;
+	RT2_PIXEL_BEGIN();
+	auto primary = FrameInfo::tracePrimary(camera, x, y);
+	//Vector4 baseColor = make4(surfacePos[0], surfacePos[1], surfacePos[2], 1.0) * 0.5 + 0.5;
+	Vector4 baseColor = Vector4(0, 0, 0, 1);
+	Vector4 targetPos(targetX, targetY);
+	if (primary.pObject)
+	{
+		baseColor = FrameInfo::shadeSurface(camera, primary, targetPos, targets, aovs);
+		auto ao = CalcateAmbient<SampleCountT, DepthT>(primary.info, primary.eyeRay, primary.pObject, FrameInfo::kernelConfig.ambientCalcCount);
+		if (aovs & AOVAmbient) targets.aoFactor->set(targetPos, ao);
+		baseColor = baseColor * ao;
+	}
+	targets.final->set(targetPos, baseColor);
+	RT2_PIXEL_END(targets.cost, targetPos);
+}
+
+void FrameInfo::traceGeometry(const CameraInfo& camera, double x, double y, double targetX, double targetY, const RenderTargets& targets)
+{
+	auto primary = FrameInfo::tracePrimary(camera, x, y);
+	if (primary.pObject) FrameInfo::shadeSurface(camera, primary, Vector4(targetX, targetY), targets, AOVDiffuse | AOVNormal | AOVDepth);
+}
+
+FrameInfo::PixelKernel FrameInfo::selectKernel(const KernelConfig& config)
+{
+	// 悭gݒ̓TvƍċA񐔂萔ɂăRpCĂ([v̓WJ萔ݍ݂)
+	struct KernelEntry
+	{
+		std::uint32_t ambientSampleCount;
+		int ambientCalcCount;
+		std::uint32_t aovs;
+		PixelKernel kernel;
+	};
+	const KernelEntry kernels[] =
+	{
+		{ 4, 0, AOVAll, &FrameInfo::tracePixel<4, 0, AOVAll> },
+		{ 4, 1, AOVAll, &FrameInfo::tracePixel<4, 1, AOVAll> },
+		{ 8, 0, AOVAll, &FrameInfo::tracePixel<8, 0, AOVAll> },
+		{ 8, 1, AOVAll, &FrameInfo::tracePixel<8, 1, AOVAll> },
+		{ 16, 0, AOVAll, &FrameInfo::tracePixel<16, 0, AOVAll> },
+		{ 16, 1, AOVAll, &FrameInfo::tracePixel<16, 1, AOVAll> },
+		// ŏIʂ̂
+		{ 4, 0, 0, &FrameInfo::tracePixel<4, 0, 0> },
+		{ 4, 1, 0, &FrameInfo::tracePixel<4, 1, 0> },
+		{ 8, 0, 0, &FrameInfo::tracePixel<8, 0, 0> },
+		{ 8, 1, 0, &FrameInfo::tracePixel<8, 1, 0> },
+		{ 16, 0, 0, &FrameInfo::tracePixel<16, 0, 0> },
+		{ 16, 1, 0, &FrameInfo::tracePixel<16, 1, 0> },
+	};
+	for (const auto& e : kernels)
+	{
+		if (e.ambientSampleCount == config.ambientSampleCount && e.ambientCalcCount == config.ambientCalcCount && e.aovs == config.aovs)
+		{
+			std::cout << "kernel: specialized(samples=" << e.ambientSampleCount << ", bounces=" << e.ambientCalcCount << ", aovs=" << e.aovs << ")" << std::endl;
+			return e.kernel;
+		}
+	}
+	std::cout << "kernel: generic(samples=" << config.ambientSampleCount << ", bounces=" << config.ambientCalcCount << ", aovs=" << config.aovs << ")" << std::endl;
+	return &FrameInfo::tracePixel<0, -1, AOVRuntime>;
+}
+
+// targets(x, y)̓sNZ(originX + x, originY + y)ɑΉ
+// ĚoobjectId, depth, normalĝŁAƂŌĂ
+std::uint32_t FrameInfo::supersampleEdges(const CameraInfo& camera, PixelKernel kernel, const RenderTargets& targets, std::uint32_t originX, std::uint32_t originY)
+{
+	auto w = targets.final->getWidth(), h = targets.final->getHeight();
+	std::vector<std::uint8_t> edges(std::size_t(w) * h, 0);
+#pragma omp parallel for
+	for (std::int32_t y = 0; y < std::int32_t(h); y++)
+	{
+		for (std::int32_t x = 0; x < std::int32_t(w); x++)
+		{
+			Vector4 pos(x, y);
+			auto id = targets.objectId->get(pos).x;
+			auto normal = targets.normal->get(pos) * 2.0f - 1.0f;
+			normal.w = 0;
+			bool edge = false;
+			// ̂̔ԍƖ@͏㉺Eׂ̗Ɣׂ
+			const std::int32_t neighbors[4][2] = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 } };
+			for (const auto& d : neighbors)
+			{
+				auto nx = x + d[0], ny = y + d[1];
+				if (nx < 0 || ny < 0 || nx >= std::int32_t(w) || ny >= std::int32_t(h)) continue;
+				Vector4 npos(nx, ny);
+				if (targets.objectId->get(npos).x != id) edge = true;
+				else if (id > 0.0f)
+				{
+					auto nnormal = targets.normal->get(npos) * 2.0f - 1.0f;
+					nnormal.w = 0;
+					if (nnormal.dot(normal) < FrameInfo::adaptiveNormalThreshold) edge = true;
+				}
+				if (edge) break;
+			}
+			// ʏł1/[xʏŐ`ɕς̂ŁAׂ̕ςƂ̂Œi𔻒f
+			// ([x̍̂܂܎gƁA΂߂Ɍ鉓ׂ̏ċEɂȂ)
+			if (!edge && id > 0.0f)
+			{
+				auto inverseDepth = 1.0f / targets.depth->get(pos).x;
+				for (std::int32_t axis = 0; axis < 2 && !edge; axis++)
+				{
+					Vector4 prev(x - (axis == 0), y - (axis == 1)), next(x + (axis == 0), y + (axis == 1));
+					if (prev.x < 0 || prev.y < 0 || next.x >= w || next.y >= h) continue;
+					if (targets.objectId->get(prev).x != id || targets.objectId->get(next).x != id) continue;
+					auto predicted = (1.0f / targets.depth->get(prev).x + 1.0f / targets.depth->get(next).x) * 0.5f;
+					edge = fabs(predicted - inverseDepth) > inverseDepth * FrameInfo::adaptiveDepthThreshold;
+				}
+			}
+			if (edge) edges[std::size_t(y) * w + x] = 1;
+		}
+	}
+
+	// sNZiqɕAe̒Ń_Ȉʒuʂ郌C΂ĕς
+	const auto grid = FrameInfo::adaptiveSampleGrid;
+	std::int32_t refinedCount = 0;
+#pragma omp parallel reduction(+:refinedCount)
+	{
+		// TvƂ̌ʂƗ̈(obt@Ƃgrid * grid x 1)
+		// \sNZȂ̂Ńv[(y[WPʂ̊m)͒ʂAXbhƂɂ܂Ƃ߂ĊmۂĂ
+		const std::size_t sampleCount = std::size_t(grid) * grid;
+		std::vector<Vector4> scratch(sampleCount * 5);
+		ColorBuffer sampleBuffers[5];
+		for (std::size_t b = 0; b < 5; b++) sampleBuffers[b].attach(scratch.data() + b * sampleCount, std::uint32_t(sampleCount), 1);
+		ColorBuffer* targetBuffers[] = { targets.diffuse, targets.normal, targets.depth, targets.aoFactor, targets.final };
+		// `ɂȂAOV̓TvłȂ
+		RenderTargets samples =
+		{
+			targets.diffuse ? &sampleBuffers[0] : nullptr, targets.normal ? &sampleBuffers[1] : nullptr,
+			targets.depth ? &sampleBuffers[2] : nullptr, targets.aoFactor ? &sampleBuffers[3] : nullptr,
+			&sampleBuffers[4], nullptr, nullptr
+		};
+		std::random_device rd;
+		std::mt19937 randomizer(rd());
+		std::uniform_real_distribution<> jitter(0.0, 1.0);
+
+#pragma omp for schedule(dynamic)
+		for (std::int32_t y = 0; y < std::int32_t(h); y++)
+		{
+			for (std::uint32_t x = 0; x < w; x++)
+			{
+				if (!edges[std::size_t(y) * w + x]) continue;
+				// wiɔTvfinalȊOȂ̂ŖĂ
+				std::fill(scratch.begin(), scratch.end(), Vector4());
+				for (std::uint32_t j = 0; j < grid; j++)
+				{
+					for (std::uint32_t i = 0; i < grid; i++)
+					{
+						auto sx = originX + x + (i + jitter(randomizer)) / grid - 0.5;
+						auto sy = originY + y + (j + jitter(randomizer)) / grid - 0.5;
+						kernel(camera, sx, sy, double(j * grid + i), 0.0, samples);
+					}
+				}
+				for (std::size_t b = 0; b < 5; b++)
+				{
+					if (!targetBuffers[b]) continue;
+					Vector4 sum;
+					for (std::size_t i = 0; i < sampleCount; i++) sum = sum + scratch[b * sampleCount + i];
+					targetBuffers[b]->set(Vector4(x, y), sum / float(sampleCount));
+				}
+				refinedCount++;
+			}
+		}
+	}
+	return std::uint32_t(refinedCount);
+}
+
+void FrameInfo::exportResults(const RenderTargets& targets, const std::wstring& prefix)
+{
+	RT2_SPAN("export");
+	if (FrameInfo::layeredImageName)
+	{
+		// [x͐xKvȂ̂floatAȊOhalf
+		LayeredImageWriter layers(targets.final->getWidth(), targets.final->getHeight());
+		// finalw͌F̃At@̕ςŔ핢ł͂Ȃ̂ŏȂ(ÂȂ摜͕sƂĈ)
+		layers.addLayer("", *targets.final, { "R", "G", "B" }, LayerPixelType::Half);
+		if (FrameInfo::aovEnabled(AOVDiffuse)) layers.addLayer("diffuse", *targets.diffuse, { "R", "G", "B" }, LayerPixelType::Half);
+		if (FrameInfo::aovEnabled(AOVNormal)) layers.addLayer("normal", *targets.normal, { "X", "Y", "Z" }, LayerPixelType::Half);
+		if (FrameInfo::aovEnabled(AOVDepth)) layers.addLayer("depth", *targets.depth, { "Z" }, LayerPixelType::Float);
+		if (FrameInfo::aovEnabled(AOVAmbient)) layers.addLayer("ao_factor", *targets.aoFactor, { "R", "G", "B" }, LayerPixelType::Half);
+		if (!layers.write(prefix + FrameInfo::layeredImageName, FrameInfo::layeredImageCompression)) std::cout << "layered image writing error" << std::endl;
+	}
+	if (FrameInfo::exportPortableNetworkGraphs)
+	{
+		if (FrameInfo::aovEnabled(AOVDiffuse)) targets.diffuse->ExportPortableNetworkGraph(prefix + L"diffuse.png");
+		if (FrameInfo::aovEnabled(AOVNormal)) targets.normal->ExportPortableNetworkGraph(prefix + L"normal.png");
+		if (FrameInfo::aovEnabled(AOVDepth)) targets.depth->ExportPortableNetworkGraph(prefix + L"depth.png");
+		if (FrameInfo::aovEnabled(AOVAmbient)) targets.aoFactor->ExportPortableNetworkGraph(prefix + L"ao_factor.png");
+		targets.final->ExportPortableNetworkGraph(prefix + L"final.png");
+	}
 }
 
 void FrameInfo::render()
@@ -95,21 +682,46 @@ void FrameInfo::render()
 		DeleteDC(hRenderContext);
 	}
 
-	ColorBuffer diffuseBuffer(FrameInfo::width, FrameInfo::height);
-	ColorBuffer aoFactorBuffer(FrameInfo::width, FrameInfo::height);
-	ColorBuffer depthBuffer(FrameInfo::width, FrameInfo::height);
-	ColorBuffer normalBuffer(FrameInfo::width, FrameInfo::height);
-	FrameInfo::final_buffer.init(FrameInfo::width, FrameInfo::height);
+	if (FrameInfo::sharedFrameBufferName && !sharedFrame.isOpen() && !sharedFrame.open(FrameInfo::sharedFrameBufferName, FrameInfo::width, FrameInfo::height))
+	{
+		std::cout << "shared frame buffer creation error(already used by another renderer or viewer?)" << std::endl;
+	}
+	if (sharedFrame.isOpen())
+	{
+		// ŏIʂ͋Lɒڕ`悷
+		FrameInfo::final_buffer.attach(sharedFrame.getPixels(), FrameInfo::width, FrameInfo::height);
+		FrameInfo::final_buffer.clear();
+		sharedFrame.beginFrame();
+	}
+	else FrameInfo::final_buffer.init(FrameInfo::width, FrameInfo::height);
 
-	double focalLength = 1 / tan((FrameInfo::hfov / 2.0) * (M_PI / 180.0));
-	std::cout << "focal length:" << focalLength << std::endl;
-	Vector4 focalPoint = Vector4(0.0, 0.0, -focalLength, 1.0);
-	double aspectValue = double(FrameInfo::height) / double(FrameInfo::width);
-	std::cout << "aspect value:" << aspectValue << std::endl;
-	std::uint64_t startTime = timeGetTime();
+	ColorBuffer costBuffer;
+	if (Instrumentation::Enabled)
+	{
+		Instrumentation::init();
+		costBuffer.init(FrameInfo::width, FrameInfo::height);
+	}
+	const bool adaptive = FrameInfo::adaptiveSampleGrid > 1;
+	ColorBuffer objectIdBuffer;
+	if (adaptive) objectIdBuffer.init(FrameInfo::width, FrameInfo::height);
 
-	// ɍsقz傫Ȃ
-	// オ}CiX
+	auto camera = FrameInfo::setupCamera();
+	// ĚodepthnormalĝŁAKIX[p[TvÔƂAOVׂďo͂
+	auto config = FrameInfo::kernelConfig;
+	if (adaptive) config.aovs = AOVAll;
+	auto kernel = FrameInfo::selectKernel(config);
+	ColorBuffer diffuseBuffer, aoFactorBuffer, depthBuffer, normalBuffer;
+	RenderTargets targets =
+	{
+		FrameInfo::aovTarget(diffuseBuffer, config.aovs, AOVDiffuse), FrameInfo::aovTarget(normalBuffer, config.aovs, AOVNormal),
+		FrameInfo::aovTarget(depthBuffer, config.aovs, AOVDepth), FrameInfo::aovTarget(aoFactorBuffer, config.aovs, AOVAmbient),
+		&FrameInfo::final_buffer, Instrumentation::Enabled ? &costBuffer : nullptr, adaptive ? &objectIdBuffer : nullptr
+	};
+	for (auto pBuffer : { targets.diffuse, targets.normal, targets.depth, targets.aoFactor })
+	{
+		if (pBuffer) pBuffer->init(FrameInfo::width, FrameInfo::height);
+	}
+	std::uint64_t startTime = timeGetTime();
 
 	std::array<double, FrameInfo::ambientSampleCount> aoSampleDegA;
 	std::array<double, FrameInfo::ambientSampleCount> aoSampleDegB;
@@ -122,72 +734,60 @@ void FrameInfo::render()
 		aoSampleDegB[i] = distr(randomizer);
 	}
 
-	for (double y = 0.0; y < FrameInfo::height; y++)
+	progress.start("rendered", FrameInfo::height);
 	{
-		if (fmod(y, 4) == 0)
+		RT2_SPAN("trace");
+		for (double y = 0.0; y < FrameInfo::height; y++)
 		{
-			std::cout << std::setw(2) << std::setfill('0') << int((y / double(FrameInfo::height)) * 100.0) << "% rendered(" << int(y) << "/" << FrameInfo::height << ") ";
-			std::cout << std::endl;
-		}
-#pragma omp parallel for
-		for (int _x = 0; _x < FrameInfo::width; _x++)
-		{
-			double x = double(_x);
-			Vector4 surfacePos((x / FrameInfo::width) * 2.0 - 1.0, ((y / FrameInfo::height) * 2.0 - 1.0) * aspectValue, 0.0, 1.0);
-			Vector4 eyeVector = surfacePos - focalPoint;
-			eyeVector.w = 0;
-			//std::cout << surfacePos << " - " << focalPoint << " = " << eyeVector << std::endl;
-			//Vector4 baseColor = make4(surfacePos[0], surfacePos[1], surfacePos[2], 1.0) * 0.5 + 0.5;
-			Vector4 baseColor = Vector4(0, 0, 0, 1);
-			Ray eyeRay(focalPoint, eyeVector.normalize());
-			//std::cout << "eyeRay:" << eyeRay << std::endl;
-
-			bool hitted = false;
-			hitTestResult htinfo;
-			auto depth = std::numeric_limits<double>::max();
-			IObjectBase* hittedObject = nullptr;
-			for (const auto& e : SceneInfo::SceneObjects)
+#pragma omp parallel
 			{
-				auto hitInfo = e->hitTest(eyeRay);
-				if (hitInfo.hit && depth > hitInfo.hitRayPosition)
+				RT2_SPAN("row", std::int32_t(y));
+#pragma omp for
+				for (int _x = 0; _x < FrameInfo::width; _x++)
 				{
-					baseColor = e->getColor();
-					//baseColor = hitInfo.normal * 0.5 + 0.5;
-					depth = hitInfo.hitRayPosition;
-					htinfo = hitInfo;
-					hittedObject = e;
-					hitted = true;
+					kernel(camera, double(_x), y, double(_x), y, targets);
 				}
 			}
-			if (hitted)
-			{
-				diffuseBuffer.set(Vector4(x, y), hittedObject->getColor());
-				normalBuffer.set(Vector4(x, y), (htinfo.normal + 1.0f) * 0.5f);
-				depthBuffer.set(Vector4(x, y), (eyeRay.Pos(htinfo.hitRayPosition) + htinfo.normal * std::numeric_limits<float>::epsilon()).z / 15.0f);
-
-				auto ao = CalcateAmbient(htinfo, eyeRay, hittedObject, FrameInfo::ambientCalcCount);
-				aoFactorBuffer.set(Vector4(x, y), ao);
-				baseColor = baseColor * ao;
-			}
-			FrameInfo::final_buffer.set(Vector4(x, y, 0, 0), baseColor);
+			if (sharedFrame.isOpen()) sharedFrame.publishTile(0, std::uint32_t(y), FrameInfo::width, 1);
+			progress.advance();
 		}
 	}
+	progress.stop();
 
-	// FXAA Antialiasing
-	std::cout << "postprocessing..." << std::endl;
-	diffuseBuffer.fxaa();
-	normalBuffer.fxaa();
-	depthBuffer.fxaa();
-	aoFactorBuffer.fxaa();
-	FrameInfo::final_buffer.fxaa();
+	if (adaptive)
+	{
+		RT2_SPAN("supersample");
+		auto refinedCount = FrameInfo::supersampleEdges(camera, kernel, targets, 0, 0);
+		std::cout << "supersampled " << refinedCount << " pixels(" << (100.0 * refinedCount / (FrameInfo::width * FrameInfo::height)) << "%)" << std::endl;
+	}
+	else
+	{
+		// FXAA Antialiasing
+		std::cout << "postprocessing..." << std::endl;
+		RT2_SPAN("fxaa");
+		if (FrameInfo::aovEnabled(AOVDiffuse)) diffuseBuffer.fxaa();
+		if (FrameInfo::aovEnabled(AOVNormal)) normalBuffer.fxaa();
+		if (FrameInfo::aovEnabled(AOVDepth)) depthBuffer.fxaa();
+		if (FrameInfo::aovEnabled(AOVAmbient)) aoFactorBuffer.fxaa();
+		FrameInfo::final_buffer.fxaa();
+	}
+	if (sharedFrame.isOpen())
+	{
+		sharedFrame.publishTile(0, 0, FrameInfo::width, FrameInfo::height);
+		sharedFrame.endFrame();
+	}
 	std::cout << "Render Time:" << (double(timeGetTime() - startTime) / 1000.0) << "s" << std::endl;
 
 	std::cout << "Writing results..." << std::endl;
-	diffuseBuffer.ExportPortableNetworkGraph(L"diffuse.png");
-	normalBuffer.ExportPortableNetworkGraph(L"normal.png");
-	depthBuffer.ExportPortableNetworkGraph(L"depth.png");
-	aoFactorBuffer.ExportPortableNetworkGraph(L"ao_factor.png");
-	FrameInfo::final_buffer.ExportPortableNetworkGraph(L"final.png");
+	FrameInfo::exportResults(targets, L"");
+	if (Instrumentation::Enabled)
+	{
+		Instrumentation::ExportHeatmap(costBuffer, 0, L"cost.png");
+		Instrumentation::ExportHeatmap(costBuffer, 1, L"ray_count.png");
+		Instrumentation::ExportHeatmap(costBuffer, 2, L"hittest_count.png");
+		Instrumentation::ExportChromeTrace(L"trace.json");
+	}
+	if (FrameInfo::headless) return;
 
 	HDC hBaseContext = GetDC(nullptr);
 	FrameInfo::hRenderContext = CreateCompatibleDC(hBaseContext);
@@ -197,6 +797,509 @@ void FrameInfo::render()
 	ReleaseDC(nullptr, hBaseContext);
 }
 
+void FrameInfo::renderBanded()
+{
+	// тƂFXAA܂ōς܂Am肵sPNG֏o
+	// т̏㉺ɂFXAA̎QƔ͈͂Ԃ̗](halo)d˂ĕ`悷
+	const std::uint32_t bufferCount = 5;
+	// mۂ̂͗LAOVfinalŁAFXAA̍ƗpRs[1
+	std::uint32_t allocatedCount = 1;
+	for (auto aov : { AOVDiffuse, AOVNormal, AOVDepth, AOVAmbient })
+	{
+		if (FrameInfo::aovEnabled(aov)) allocatedCount++;
+	}
+	auto rowBytes = std::uint64_t(FrameInfo::width) * sizeof(Vector4) * (allocatedCount + 1);
+	auto budgetRows = std::int64_t(FrameInfo::bandMemoryBudget / rowBytes) - 2 * std::int64_t(FrameInfo::bandHalo);
+	if (budgetRows < 1)
+	{
+		// 1s+halo܂Ȃ\Z͎Ȃ̂ŁAŏ\ŕ`悷邱Ƃm点
+		std::cout << "warning: bandMemoryBudget(" << FrameInfo::bandMemoryBudget << " bytes) is too small, using "
+			<< rowBytes * (1 + 2 * FrameInfo::bandHalo) << " bytes(1 row + halo)" << std::endl;
+	}
+	auto bandRows = std::uint32_t(clamp<std::int64_t>(budgetRows, 1, FrameInfo::height));
+	std::cout << "Band Rendering: " << bandRows << " rows/band (+" << FrameInfo::bandHalo << " halo rows)" << std::endl;
+	// v[ɎĉFXAA̍ƗpRs[1܂(т̍ςƂɌÂubN܂܂ɂȂ)
+	auto& pool = FrameBufferPool::instance();
+	pool.setMaxPooledBytes(std::size_t(FrameInfo::width) * sizeof(Vector4) * (bandRows + 2 * FrameInfo::bandHalo));
+
+	ColorBuffer diffuseBuffer, aoFactorBuffer, depthBuffer, normalBuffer, finalBuffer;
+	const auto aovs = FrameInfo::kernelConfig.aovs;
+	RenderTargets targets =
+	{
+		FrameInfo::aovTarget(diffuseBuffer, aovs, AOVDiffuse), FrameInfo::aovTarget(normalBuffer, aovs, AOVNormal),
+		FrameInfo::aovTarget(depthBuffer, aovs, AOVDepth), FrameInfo::aovTarget(aoFactorBuffer, aovs, AOVAmbient),
+		&finalBuffer, nullptr, nullptr
+	};
+	// AOṼt@C͊JȂ(JĂȂXg[ւ݂͉̏Ȃ)Afinal͏ɏ
+	struct BandOutput
+	{
+		std::uint32_t aov;
+		ColorBuffer* pBuffer;
+		const wchar_t* fileName;
+	};
+	const BandOutput outputs[bufferCount] =
+	{
+		{ AOVDiffuse, &diffuseBuffer, L"diffuse.png" },
+		{ AOVNormal, &normalBuffer, L"normal.png" },
+		{ AOVDepth, &depthBuffer, L"depth.png" },
+		{ AOVAmbient, &aoFactorBuffer, L"ao_factor.png" },
+		{ 0, &finalBuffer, L"final.png" },
+	};
+	std::array<PortableNetworkGraphStream, bufferCount> streams;
+	for (std::uint32_t i = 0; i < bufferCount; i++)
+	{
+		if (outputs[i].aov != 0 && !FrameInfo::aovEnabled(outputs[i].aov)) continue;
+		if (!streams[i].open(outputs[i].fileName, FrameInfo::width, FrameInfo::height))
+		{
+			std::cout << "error opening output files" << std::endl;
+			exit(-4);
+		}
+	}
+
+	if (Instrumentation::Enabled) Instrumentation::init();
+	auto camera = FrameInfo::setupCamera();
+	auto kernel = FrameInfo::selectKernel(FrameInfo::kernelConfig);
+	std::uint64_t startTime = timeGetTime();
+
+	progress.start("rendered", FrameInfo::height);
+	for (std::uint32_t top = 0; top < FrameInfo::height; top += bandRows)
+	{
+		RT2_SPAN("band", std::int32_t(top));
+		auto rows = min(bandRows, FrameInfo::height - top);
+		auto first = top > FrameInfo::bandHalo ? top - FrameInfo::bandHalo : 0;
+		auto last = min(top + rows + FrameInfo::bandHalo, FrameInfo::height);
+
+		// 摜̒[łFXAAт̒[ŃNv悤ɁAт̍ɍ킹Ă
+		if (finalBuffer.getHeight() != last - first)
+		{
+			// O̍̃ubN(FXAÃRs[܂)̓v[Ɏc
+			pool.trim();
+			for (auto pBuffer : { targets.diffuse, targets.normal, targets.depth, targets.aoFactor, targets.final })
+			{
+				if (pBuffer) pBuffer->init(FrameInfo::width, last - first);
+			}
+			pool.trim();
+		}
+		else
+		{
+			for (auto pBuffer : { targets.diffuse, targets.normal, targets.depth, targets.aoFactor, targets.final })
+			{
+				if (pBuffer) pBuffer->clear();
+			}
+		}
+		for (auto y = first; y < last; y++)
+		{
+#pragma omp parallel
+			{
+				RT2_SPAN("row", std::int32_t(y));
+#pragma omp for
+				for (int _x = 0; _x < FrameInfo::width; _x++)
+				{
+					kernel(camera, double(_x), double(y), double(_x), double(y - first), targets);
+				}
+			}
+		}
+
+		{
+			RT2_SPAN("fxaa", std::int32_t(top));
+			if (FrameInfo::aovEnabled(AOVDiffuse)) diffuseBuffer.fxaa();
+			if (FrameInfo::aovEnabled(AOVNormal)) normalBuffer.fxaa();
+			if (FrameInfo::aovEnabled(AOVDepth)) depthBuffer.fxaa();
+			if (FrameInfo::aovEnabled(AOVAmbient)) aoFactorBuffer.fxaa();
+			finalBuffer.fxaa();
+		}
+
+		{
+			RT2_SPAN("export", std::int32_t(top));
+			for (std::uint32_t i = 0; i < bufferCount; i++) streams[i].writeRows(*outputs[i].pBuffer, top - first, rows);
+		}
+		progress.advance(rows);
+	}
+	progress.stop();
+	for (auto& st : streams) st.close();
+	std::cout << "Render Time:" << (double(timeGetTime() - startTime) / 1000.0) << "s" << std::endl;
+	if (Instrumentation::Enabled) Instrumentation::ExportChromeTrace(L"trace.json");
+}
+
+void FrameInfo::renderCrop(const RenderRegion& region)
+{
+	// FXAA̎QƔ͈͂Ԃ(bandHalo)͂`悵A㏈̂ƂŐ؂o(S̕`ƓʂɂȂ)
+	auto regionLeft = min(region.left, FrameInfo::width - 1), regionTop = min(region.top, FrameInfo::height - 1);
+	auto regionWidth = min(region.width, FrameInfo::width - regionLeft), regionHeight = min(region.height, FrameInfo::height - regionTop);
+	auto left = regionLeft > FrameInfo::bandHalo ? regionLeft - FrameInfo::bandHalo : 0;
+	auto top = regionTop > FrameInfo::bandHalo ? regionTop - FrameInfo::bandHalo : 0;
+	auto right = min(regionLeft + regionWidth + FrameInfo::bandHalo, FrameInfo::width);
+	auto bottom = min(regionTop + regionHeight + FrameInfo::bandHalo, FrameInfo::height);
+	std::cout << "Crop Rendering: (" << regionLeft << ", " << regionTop << ") " << regionWidth << "x" << regionHeight << std::endl;
+
+	const bool adaptive = FrameInfo::adaptiveSampleGrid > 1;
+	ColorBuffer objectIdBuffer;
+	if (adaptive) objectIdBuffer.init(right - left, bottom - top);
+	auto config = FrameInfo::kernelConfig;
+	if (adaptive) config.aovs = AOVAll;
+	ColorBuffer diffuseBuffer, aoFactorBuffer, depthBuffer, normalBuffer;
+	ColorBuffer finalBuffer(right - left, bottom - top);
+	RenderTargets targets =
+	{
+		FrameInfo::aovTarget(diffuseBuffer, config.aovs, AOVDiffuse), FrameInfo::aovTarget(normalBuffer, config.aovs, AOVNormal),
+		FrameInfo::aovTarget(depthBuffer, config.aovs, AOVDepth), FrameInfo::aovTarget(aoFactorBuffer, config.aovs, AOVAmbient),
+		&finalBuffer, nullptr, adaptive ? &objectIdBuffer : nullptr
+	};
+	for (auto pBuffer : { targets.diffuse, targets.normal, targets.depth, targets.aoFactor })
+	{
+		if (pBuffer) pBuffer->init(right - left, bottom - top);
+	}
+
+	if (Instrumentation::Enabled) Instrumentation::init();
+	auto camera = FrameInfo::setupCamera();
+	auto kernel = FrameInfo::selectKernel(config);
+	std::uint64_t startTime = timeGetTime();
+
+	progress.start("rendered", bottom - top);
+	for (auto y = top; y < bottom; y++)
+	{
+#pragma omp parallel
+		{
+			RT2_SPAN("row", std::int32_t(y));
+#pragma omp for
+			for (std::int32_t _x = std::int32_t(left); _x < std::int32_t(right); _x++)
+			{
+				kernel(camera, double(_x), double(y), double(_x - std::int32_t(left)), double(y - top), targets);
+			}
+		}
+		progress.advance();
+	}
+	progress.stop();
+
+	if (adaptive)
+	{
+		RT2_SPAN("supersample");
+		auto refinedCount = FrameInfo::supersampleEdges(camera, kernel, targets, left, top);
+		std::cout << "supersampled " << refinedCount << " pixels" << std::endl;
+	}
+	else
+	{
+		RT2_SPAN("fxaa");
+		if (FrameInfo::aovEnabled(AOVDiffuse)) diffuseBuffer.fxaa();
+		if (FrameInfo::aovEnabled(AOVNormal)) normalBuffer.fxaa();
+		if (FrameInfo::aovEnabled(AOVDepth)) depthBuffer.fxaa();
+		if (FrameInfo::aovEnabled(AOVAmbient)) aoFactorBuffer.fxaa();
+		finalBuffer.fxaa();
+	}
+	std::cout << "Render Time:" << (double(timeGetTime() - startTime) / 1000.0) << "s" << std::endl;
+
+	// ؂ô͏o͂AOV
+	const auto aovs = FrameInfo::kernelConfig.aovs;
+	ColorBuffer croppedDiffuse, croppedNormal, croppedDepth, croppedAmbient, croppedFinal;
+	RenderTargets cropped =
+	{
+		FrameInfo::aovTarget(croppedDiffuse, aovs, AOVDiffuse), FrameInfo::aovTarget(croppedNormal, aovs, AOVNormal),
+		FrameInfo::aovTarget(croppedDepth, aovs, AOVDepth), FrameInfo::aovTarget(croppedAmbient, aovs, AOVAmbient),
+		&croppedFinal, nullptr, nullptr
+	};
+	ColorBuffer* sources[] = { targets.diffuse, targets.normal, targets.depth, targets.aoFactor, targets.final };
+	ColorBuffer* destinations[] = { cropped.diffuse, cropped.normal, cropped.depth, cropped.aoFactor, cropped.final };
+	for (std::size_t i = 0; i < 5; i++)
+	{
+		if (!destinations[i]) continue;
+		destinations[i]->init(regionWidth, regionHeight);
+		destinations[i]->copyRegion(*sources[i], regionLeft - left, regionTop - top);
+	}
+	std::cout << "Writing results..." << std::endl;
+	FrameInfo::exportResults(cropped, L"crop_");
+	if (Instrumentation::Enabled) Instrumentation::ExportChromeTrace(L"trace.json");
+}
+
+void FrameInfo::renderProxy(std::uint32_t scale)
+{
+	// 1/scalẻ𑜓xAO܂ŌvZAS𑜓ẍꎟCGobt@(diffuse, normal, depth)肪AOԂ
+	// 𑜓x̃sNZscale x scalẽubN̒Sʂ郌Cɂ
+	auto lowWidth = (FrameInfo::width + scale - 1) / scale, lowHeight = (FrameInfo::height + scale - 1) / scale;
+	const double offset = (scale - 1) * 0.5;
+	std::cout << "Proxy Rendering: 1/" << scale << "(" << lowWidth << ", " << lowHeight << ")" << std::endl;
+
+	// wiǂobjectId(0Ȃwi)Ŕ肷([x͎_Ɠeʂ̊Ԃ̂̕ł0ȉɂȂ)
+	ColorBuffer lowDiffuse(lowWidth, lowHeight), lowNormal(lowWidth, lowHeight), lowDepth(lowWidth, lowHeight), lowAmbient(lowWidth, lowHeight), lowFinal(lowWidth, lowHeight), lowObjectId(lowWidth, lowHeight);
+	RenderTargets lowTargets = { &lowDiffuse, &lowNormal, &lowDepth, &lowAmbient, &lowFinal, nullptr, &lowObjectId };
+	ColorBuffer diffuseBuffer(FrameInfo::width, FrameInfo::height);
+	ColorBuffer aoFactorBuffer(FrameInfo::width, FrameInfo::height);
+	ColorBuffer depthBuffer(FrameInfo::width, FrameInfo::height);
+	ColorBuffer normalBuffer(FrameInfo::width, FrameInfo::height);
+	ColorBuffer objectIdBuffer(FrameInfo::width, FrameInfo::height);
+	FrameInfo::final_buffer.init(FrameInfo::width, FrameInfo::height);
+	RenderTargets targets = { &diffuseBuffer, &normalBuffer, &depthBuffer, &aoFactorBuffer, &FrameInfo::final_buffer, nullptr, &objectIdBuffer };
+
+	if (Instrumentation::Enabled) Instrumentation::init();
+	auto camera = FrameInfo::setupCamera();
+	// Ԃɒ𑜓xGobt@ĝŁAAOVׂ͂ďo͂
+	auto lowConfig = FrameInfo::kernelConfig;
+	lowConfig.aovs = AOVAll;
+	auto kernel = FrameInfo::selectKernel(lowConfig);
+	std::uint64_t startTime = timeGetTime();
+
+	progress.start("rendered(proxy)", lowHeight);
+	for (std::uint32_t ly = 0; ly < lowHeight; ly++)
+	{
+#pragma omp parallel
+		{
+			RT2_SPAN("row", std::int32_t(ly));
+#pragma omp for
+			for (std::int32_t lx = 0; lx < std::int32_t(lowWidth); lx++)
+			{
+				kernel(camera, lx * scale + offset, ly * scale + offset, double(lx), double(ly), lowTargets);
+			}
+		}
+		progress.advance();
+	}
+	progress.stop();
+
+	{
+		RT2_SPAN("gbuffer");
+#pragma omp parallel for schedule(dynamic)
+		for (std::int32_t y = 0; y < std::int32_t(FrameInfo::height); y++)
+		{
+			for (std::uint32_t x = 0; x < FrameInfo::width; x++) FrameInfo::traceGeometry(camera, double(x), double(y), double(x), double(y), targets);
+		}
+	}
+
+	// oCe: ߂̒𑜓xTvA[x̍A@̌ŏdݕt
+	// gTvȂ(𑜓xł͎ʂȂׂ̂Ȃ)sNZ͂̂܂ܕ`悷
+	std::int32_t refinedCount = 0;
+	{
+		RT2_SPAN("upsample");
+#pragma omp parallel for schedule(dynamic) reduction(+:refinedCount)
+		for (std::int32_t y = 0; y < std::int32_t(FrameInfo::height); y++)
+		{
+			for (std::uint32_t x = 0; x < FrameInfo::width; x++)
+			{
+				Vector4 pos(x, y);
+				if (objectIdBuffer.get(pos).x == 0.0f)
+				{
+					FrameInfo::final_buffer.set(pos, Vector4(0, 0, 0, 1));
+					continue;
+				}
+				auto depth = depthBuffer.get(pos).x;
+				auto depthScale = max(float(fabs(depth)), 1.0e-3f) * FrameInfo::proxyDepthTolerance;
+				auto normal = normalBuffer.get(pos) * 2.0f - 1.0f;
+				normal.w = 0;
+
+				auto lx = (x - offset) / scale, ly = (y - offset) / scale;
+				auto baseX = std::int32_t(floor(lx)), baseY = std::int32_t(floor(ly));
+				Vector4 ambient;
+				float weightSum = 0.0f;
+				for (std::int32_t sy = baseY - 1; sy <= baseY + 2; sy++)
+				{
+					if (sy < 0 || sy >= std::int32_t(lowHeight)) continue;
+					for (std::int32_t sx = baseX - 1; sx <= baseX + 2; sx++)
+					{
+						if (sx < 0 || sx >= std::int32_t(lowWidth)) continue;
+						Vector4 samplePos(sx, sy);
+						if (lowObjectId.get(samplePos).x == 0.0f) continue;
+						auto sampleDepth = lowDepth.get(samplePos).x;
+						auto sampleNormal = lowNormal.get(samplePos) * 2.0f - 1.0f;
+						sampleNormal.w = 0;
+
+						auto spatial = exp(-float(pow(lx - sx, 2.0) + pow(ly - sy, 2.0)));
+						auto depthDiff = (sampleDepth - depth) / depthScale;
+						auto weight = spatial * exp(-depthDiff * depthDiff) * pow(max(sampleNormal.dot(normal), 0.0f), FrameInfo::proxyNormalPower);
+						ambient = ambient + lowAmbient.get(samplePos) * weight;
+						weightSum += weight;
+					}
+				}
+				if (weightSum < 1.0e-3f)
+				{
+					kernel(camera, double(x), double(y), double(x), double(y), targets);
+					refinedCount++;
+					continue;
+				}
+				ambient = ambient / weightSum;
+				aoFactorBuffer.set(pos, ambient);
+				FrameInfo::final_buffer.set(pos, diffuseBuffer.get(pos) * ambient);
+			}
+		}
+	}
+	std::cout << "traced " << refinedCount << " pixels at full resolution" << std::endl;
+
+	{
+		RT2_SPAN("fxaa");
+		if (FrameInfo::aovEnabled(AOVDiffuse)) diffuseBuffer.fxaa();
+		if (FrameInfo::aovEnabled(AOVNormal)) normalBuffer.fxaa();
+		if (FrameInfo::aovEnabled(AOVDepth)) depthBuffer.fxaa();
+		if (FrameInfo::aovEnabled(AOVAmbient)) aoFactorBuffer.fxaa();
+		FrameInfo::final_buffer.fxaa();
+	}
+	std::cout << "Render Time:" << (double(timeGetTime() - startTime) / 1000.0) << "s" << std::endl;
+
+	std::cout << "Writing results..." << std::endl;
+	FrameInfo::exportResults(targets, L"proxy_");
+	if (Instrumentation::Enabled) Instrumentation::ExportChromeTrace(L"trace.json");
+}
+
+void FrameInfo::runBenchmark()
+{
+	// v͕̂`ƕς̍XV̂(덷̌vZt@Co͂̎Ԃ͊܂߂Ȃ)
+	// FXAA͎gȂ(QƉ摜)
+	auto scale = FrameInfo::benchmarkScale;
+	auto benchWidth = (FrameInfo::width + scale - 1) / scale, benchHeight = (FrameInfo::height + scale - 1) / scale;
+	const double offset = (scale - 1) * 0.5;
+	std::cout << "Benchmark Frame Size:(" << benchWidth << ", " << benchHeight << ")" << std::endl;
+
+	std::ofstream csv("benchmark.csv");
+	csv << "scene,config,samples,bounces,analytic_spheres,passes,time,final_rmse,final_ssim,ao_rmse,ao_ssim" << std::endl;
+
+	ColorBuffer diffuseBuffer(benchWidth, benchHeight);
+	ColorBuffer aoFactorBuffer(benchWidth, benchHeight);
+	ColorBuffer depthBuffer(benchWidth, benchHeight);
+	ColorBuffer normalBuffer(benchWidth, benchHeight);
+	ColorBuffer finalBuffer(benchWidth, benchHeight);
+	RenderTargets targets = { &diffuseBuffer, &normalBuffer, &depthBuffer, &aoFactorBuffer, &finalBuffer, nullptr, nullptr };
+	ColorBuffer finalMean(benchWidth, benchHeight), aoMean(benchWidth, benchHeight);
+	// sƂ̕`(r̍s܂łIĂȂ񂪂̂ōsƂɕς)
+	std::vector<std::uint32_t> rowPasses(benchHeight);
+	auto camera = FrameInfo::setupCamera();
+	auto savedConfig = FrameInfo::kernelConfig;
+
+	auto resetMean = [&]()
+	{
+		finalMean.clear();
+		aoMean.clear();
+		std::fill(rowPasses.begin(), rowPasses.end(), 0);
+	};
+	// topsrowss1`悵ĕςɉ
+	auto renderBlock = [&](PixelKernel kernel, std::uint32_t top, std::uint32_t rows)
+	{
+		for (auto y = top; y < top + rows; y++)
+		{
+#pragma omp parallel for
+			for (std::int32_t x = 0; x < std::int32_t(benchWidth); x++)
+			{
+				// wiłAOȂ̂ŏĂ
+				aoFactorBuffer.set(Vector4(x, y), Vector4());
+				kernel(camera, x * scale + offset, y * scale + offset, double(x), double(y), targets);
+			}
+			auto n = float(++rowPasses[y]);
+			for (std::uint32_t x = 0; x < benchWidth; x++)
+			{
+				Vector4 pos(x, y);
+				finalMean.set(pos, finalMean.get(pos) + (finalBuffer.get(pos) - finalMean.get(pos)) / n);
+				aoMean.set(pos, aoMean.get(pos) + (aoFactorBuffer.get(pos) - aoMean.get(pos)) / n);
+			}
+		}
+	};
+	auto useConfig = [&](const BenchmarkConfig& bc)
+	{
+		// ėpJ[lkernelConfig𒼐ڌ̂Őݒ肵Ă
+		KernelConfig config = { bc.ambientSampleCount, bc.ambientCalcCount, AOVAll };
+		FrameInfo::kernelConfig = config;
+		return FrameInfo::selectKernel(config);
+	};
+
+	for (std::uint32_t scene = 0; scene < SceneInfo::TestSceneCount; scene++)
+	{
+		std::string sceneName = SceneInfo::initTestScene(scene);
+		std::cout << "scene: " << sceneName << std::endl;
+
+		// QƉ摜: [version, width, height, samples, bounces, analytic spheres, passes][final][ao_factor](passes͋L^̂)
+		ColorBuffer referenceFinal(benchWidth, benchHeight), referenceAmbient(benchWidth, benchHeight);
+		auto referenceName = "benchmark_reference_" + sceneName + ".bin";
+		const bool referenceAnalytic = false;
+		std::uint32_t header[7] = { benchmarkReferenceVersion, benchWidth, benchHeight, benchmarkReference.ambientSampleCount, std::uint32_t(benchmarkReference.ambientCalcCount), referenceAnalytic ? 1u : 0u, 0 };
+		std::vector<Vector4> pixels(std::size_t(benchWidth) * benchHeight * 2);
+		bool loaded = false;
+		FILE* fp = nullptr;
+		if (fopen_s(&fp, referenceName.c_str(), "rb") == 0)
+		{
+			std::uint32_t fileHeader[7];
+			loaded = fread(fileHeader, sizeof fileHeader, 1, fp) == 1 && std::equal(header, header + 6, fileHeader) &&
+				fread(pixels.data(), sizeof(Vector4), pixels.size(), fp) == pixels.size();
+			fclose(fp);
+			if (loaded) std::cout << "using cached reference(" << referenceName << ", " << fileHeader[6] << " passes)" << std::endl;
+		}
+		if (loaded)
+		{
+			for (std::uint32_t y = 0; y < benchHeight; y++)
+			{
+				for (std::uint32_t x = 0; x < benchWidth; x++)
+				{
+					auto i = std::size_t(y) * benchWidth + x;
+					referenceFinal.set(Vector4(x, y), pixels[i]);
+					referenceAmbient.set(Vector4(x, y), pixels[pixels.size() / 2 + i]);
+				}
+			}
+		}
+		else
+		{
+			auto kernel = useConfig(benchmarkReference);
+			auto savedAnalytic = FrameInfo::analyticSphereOcclusion;
+			FrameInfo::analyticSphereOcclusion = referenceAnalytic;
+			resetMean();
+			double elapsed = 0.0;
+			std::uint32_t passes = 0;
+			while (elapsed < FrameInfo::benchmarkReferenceBudget || passes < FrameInfo::benchmarkReferenceMinPasses)
+			{
+				std::uint64_t startTime = timeGetTime();
+				renderBlock(kernel, 0, benchHeight);
+				elapsed += double(timeGetTime() - startTime) / 1000.0;
+				passes++;
+				std::cout << "reference pass " << passes << ": " << elapsed << "s" << std::endl;
+			}
+			FrameInfo::analyticSphereOcclusion = savedAnalytic;
+			header[6] = passes;
+			referenceFinal.copyRegion(finalMean, 0, 0);
+			referenceAmbient.copyRegion(aoMean, 0, 0);
+			for (std::uint32_t y = 0; y < benchHeight; y++)
+			{
+				std::copy(finalMean.getLine(y), finalMean.getLine(y) + benchWidth, pixels.begin() + std::size_t(y) * benchWidth);
+				std::copy(aoMean.getLine(y), aoMean.getLine(y) + benchWidth, pixels.begin() + pixels.size() / 2 + std::size_t(y) * benchWidth);
+			}
+			if (fopen_s(&fp, referenceName.c_str(), "wb") == 0)
+			{
+				fwrite(header, sizeof header, 1, fp);
+				fwrite(pixels.data(), sizeof(Vector4), pixels.size(), fp);
+				fclose(fp);
+			}
+			referenceFinal.ExportPortableNetworkGraph(std::wstring(L"benchmark_reference_") + std::wstring(sceneName.begin(), sceneName.end()) + L".png");
+		}
+
+		// Ԃ̏܂ōs̃ubNPʂŕ`JԂA`FbN|CgƂɌ덷L^
+		// (ԗ\Z𑝂₵Ȃ瑪̂ƓȐɂȂ)
+		for (const auto& bc : FrameInfo::benchmarkConfigs)
+		{
+			auto kernel = useConfig(bc);
+			resetMean();
+			double elapsed = 0.0, nextCheckpoint = 0.0;
+			std::uint64_t renderedRows = 0;
+			std::uint32_t top = 0;
+			// 𒴂Ăŏ1񕪂͕`I
+			while (elapsed < FrameInfo::benchmarkTimeBudget || renderedRows < benchHeight)
+			{
+				auto rows = min(FrameInfo::benchmarkBlockRows, benchHeight - top);
+				std::uint64_t startTime = timeGetTime();
+				renderBlock(kernel, top, rows);
+				elapsed += double(timeGetTime() - startTime) / 1000.0;
+				renderedRows += rows;
+				top = top + rows < benchHeight ? top + rows : 0;
+
+				// Ŝ1`I܂ł͋L^Ȃ
+				if (renderedRows < benchHeight) continue;
+				if (elapsed < nextCheckpoint && elapsed < FrameInfo::benchmarkTimeBudget) continue;
+				nextCheckpoint = elapsed * FrameInfo::benchmarkCheckpointRatio;
+
+				// 1sNZ̕ϕ`
+				auto passes = double(renderedRows) / benchHeight;
+				auto finalError = ImageMetrics::RootMeanSquareError(finalMean, referenceFinal);
+				auto finalSimilarity = ImageMetrics::StructuralSimilarity(finalMean, referenceFinal);
+				auto aoError = ImageMetrics::RootMeanSquareError(aoMean, referenceAmbient);
+				auto aoSimilarity = ImageMetrics::StructuralSimilarity(aoMean, referenceAmbient);
+				csv << sceneName << "," << bc.name << "," << bc.ambientSampleCount << "," << bc.ambientCalcCount << "," << (FrameInfo::analyticSphereOcclusion ? 1 : 0) << "," << passes << "," << elapsed << ","
+					<< finalError << "," << finalSimilarity << "," << aoError << "," << aoSimilarity << std::endl;
+				std::cout << sceneName << "/" << bc.name << " " << passes << " passes: " << elapsed << "s final rmse " << finalError << " ao rmse " << aoError << std::endl;
+			}
+		}
+	}
+	FrameInfo::kernelConfig = savedConfig;
+}
+
 void Window::show()
 {
 	if (hWnd) DestroyWindow(hWnd);
@@ -265,11 +1368,17 @@ LRESULT CALLBACK Window::WndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lPa
 	return DefWindowProc(hWnd, uMsg, wParam, lParam);
 }
 
+template<std::uint32_t SampleCountT, int DepthT>
 Vector4 CalcateAmbient(const hitTestResult& htres, const Ray& ray, IObjectBase* processingObjectFrom, const int StepCounter)
 {
 	// rayƏՓ˂processingObjectFrom̏Փ˓_(\ʁAՓˏhtres)̃ArGgvZ
+	// SampleCountT/DepthTLȂTv/c̍ċA񐔂͒萔ɂȂ
+	// TvCprocessingObjectFrom(V[̕)ŜOĔ΂
+	// Instance/ObjectGroup̏ꍇ͂̒̑SĂ̎qÔŁACX^X̕im݂͌ՕȂ
+	const std::uint32_t sampleCount = SampleCountT ? SampleCountT : FrameInfo::kernelConfig.ambientSampleCount;
+	const int steps = DepthT < 0 ? StepCounter : DepthT;
 
-	if (typeid(*processingObjectFrom) != typeid(Plane))
+	if (!processingObjectFrom->isEmissive())
 	{
 		// @ڋԍs߂(orthoBasis)
 		std::array<Vector4, 3> basis;
@@ -300,10 +1409,26 @@ Vector4 CalcateAmbient(const hitTestResult& htres, const Ray& ray, IObjectBase*
 		std::mt19937 randomizer(rd());
 		static std::uniform_real_distribution<> distr_norm(0.0, 1.0);
 		static std::uniform_real_distribution<> distr_phi(0.0, 2.0 * M_PI);
+
+		// ߂̋ɂՕ͓Iɋ߂ďZō(TvC͋ȊOɑ΂Ă̂ݔ΂)
+		double sphereVisibility = 1.0;
+		if (FrameInfo::analyticSphereOcclusion)
+		{
+			auto surfacePos = ray.Pos(htres.hitRayPosition);
+			for (const auto& e : SceneInfo::SceneObjects)
+			{
+				if (e == processingObjectFrom || typeid(*e) != typeid(Sphere)) continue;
+				auto pSphere = static_cast<Sphere*>(e);
+				if ((pSphere->getPos() - surfacePos).length() - pSphere->getRadius() > FrameInfo::sphereOcclusionRange) continue;
+				sphereVisibility *= 1.0 - pSphere->occlusion(surfacePos, htres.normal);
+			}
+			if (sphereVisibility <= 0.0) return Vector4();
+		}
+
 		// ϕ
-		for (std::int32_t phi_d = 0; phi_d < FrameInfo::ambientSampleCount; phi_d++)
+		for (std::uint32_t phi_d = 0; phi_d < sampleCount; phi_d++)
 		{
-			for (std::int32_t theta_d = 0; theta_d < FrameInfo::ambientSampleCount; theta_d++)
+			for (std::uint32_t theta_d = 0; theta_d < sampleCount; theta_d++)
 			{
 				auto r = sqrt(distr_norm(randomizer));
 				auto phi = distr_phi(randomizer);
@@ -314,6 +1439,7 @@ Vector4 CalcateAmbient(const hitTestResult& htres, const Ray& ray, IObjectBase*
 				vecSampleRay.y = localVector.x * basis[0].y + localVector.y * basis[1].y + localVector.z * basis[2].y;
 				vecSampleRay.z = localVector.x * basis[0].z + localVector.y * basis[1].z + localVector.z * basis[2].z;
 				Ray sampleRay(ray.Pos(htres.hitRayPosition) + htres.normal * std::numeric_limits<double>::epsilon(), vecSampleRay);
+				RT2_COUNT_RAY();
 
 				bool hitted = false;
 				IObjectBase* pHittedAmbientObject = nullptr;
@@ -322,6 +1448,8 @@ Vector4 CalcateAmbient(const hitTestResult& htres, const Ray& ray, IObjectBase*
 				for (const auto& e : SceneInfo::SceneObjects)
 				{
 					if (e == processingObjectFrom) continue;
+					if (FrameInfo::analyticSphereOcclusion && typeid(*e) == typeid(Sphere)) continue;
+					RT2_COUNT_HITTEST();
 					auto hitInfo = e->hitTest(sampleRay);
 					if (hitInfo.hit && hitInfo.hitRayPosition < distNearest)
 					{
@@ -333,14 +1461,14 @@ Vector4 CalcateAmbient(const hitTestResult& htres, const Ray& ray, IObjectBase*
 				}
 				if (hitted)
 				{
-					if (StepCounter > 0)
+					if (steps > 0)
 					{
 						// ܂vZׂłȂAՓ˂IuWFNgVɍs
-						ambient = ambient + CalcateAmbient(hti, sampleRay, pHittedAmbientObject, StepCounter - 1) * max(1.0 - sqrt(distNearest / 16.0), 0.0);
+						ambient = ambient + CalcateAmbient<SampleCountT, (DepthT < 0 ? -1 : (DepthT > 0 ? DepthT - 1 : 0))>(hti, sampleRay, pHittedAmbientObject, steps - 1) * max(1.0 - sqrt(distNearest / 16.0), 0.0);
 					}
 					else
 					{
-						if (typeid(*pHittedAmbientObject) == typeid(Plane))
+						if (pHittedAmbientObject->isEmissive())
 						{
 							// plane(illuminating)
 							ambient = ambient + pHittedAmbientObject->getColor() * max(1.0 - sqrt(distNearest / 16.0), 0.0);
@@ -349,11 +1477,11 @@ Vector4 CalcateAmbient(const hitTestResult& htres, const Ray& ray, IObjectBase*
 				}
 			}
 		}
-		return ambient / float(FrameInfo::ambientSampleCount * FrameInfo::ambientSampleCount);
+		return ambient * sphereVisibility / float(sampleCount * sampleCount);
 	}
 	else
 	{
-		// Planê͔玩g̐F
+		// (PlaneA܂PlaneInstance)͎g̐F
 		return processingObjectFrom->getColor();
 	}
 }